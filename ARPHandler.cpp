@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <hostutil.h>
 #include <Buffer.h>
+#include <Headers.h>
 #include "IPHandler.h"
 #include "ARPHandler.h"
 
@@ -61,87 +62,73 @@ ARPHandler::ARPHandler(uint8_t *ipAddress, uint8_t routingTableSize,
 /*                          A R P    M G M T                            */
 /* ==================================================================== */
 bool ARPHandler::sendARPRequest(uint8_t target_protocol_addr[4]){
+  //the target's hardware address is what we are asking for
+  static const uint8_t unknownMAC[6] = {0,0,0,0,0,0};
 
-  Buffer* etherBuffer = etherControl->getSendPayloadBuffer();
-
-  uint8_t *sender_hardware_addr = etherControl->getMACAddress();
-
-  if (!etherBuffer->writeNet16(0,ETH_PROTOCOL)) return false; // 1 for ethernet
-  if (!etherBuffer->writeNet16(2,IP_PROTOCOL)) return false;  // 0x0800 for IP
-  if (!etherBuffer->write8(4,6)) return false; // mac addresses are 6 bytess
-  if (!etherBuffer->write8(5,4)) return false; // IPv4 addresses are 4 bytes
-  if (!etherBuffer->writeNet16(6,ARP_REQUEST)) return false;  // 1 is request
-  if (!etherBuffer->write(8,sender_hardware_addr,6)) return false; //sender mac
-
-  if (!etherBuffer->write(14,ipAddress,4)) return false;           //sender ip
-
- //target hw address
-  for(int i=0;i<6;i++)
-    if (!etherBuffer->write8(18+i,0x00)) return false;
-
-  //target ip address
-  if (!etherBuffer->write(24,target_protocol_addr,4)) return false;
-
-  return etherControl->sendFrame(broadcastMAC,ARP_PROTOCOL,28);
+  return sendARPPacket(ARP_REQUEST,unknownMAC,target_protocol_addr,
+		       broadcastMAC);
 }//end sendARPRequest
 
 //send my IP and my mac to the requestor
 bool ARPHandler::sendARPResponse(uint8_t target_hardware_addr[6],
 			  uint8_t target_protocol_addr[4]){
+  return sendARPPacket(ARP_RESPONSE,target_hardware_addr,
+		       target_protocol_addr,target_hardware_addr);
+}//end sendARPResponse
 
-  Buffer* etherBuffer = etherControl->getSendPayloadBuffer();
+//the packet is put together in memory and written in one go
+bool ARPHandler::sendARPPacket(uint16_t operation, 
+			       const uint8_t* target_hardware_addr,
+			       const uint8_t* target_protocol_addr,
+			       const uint8_t* destination){
 
-  uint8_t *sender_hardware_addr = etherControl->getMACAddress();
-  
-  if (!etherBuffer->writeNet16(0,ETH_PROTOCOL)) return false; // 1 for ethernet
-  if (!etherBuffer->writeNet16(2,IP_PROTOCOL)) return false;   // 0x0800 for IP
-  if (!etherBuffer->write8(4,6)) return false; // mac addresses are 6 bytes
-  if (!etherBuffer->write8(5,4)) return false; // IPv4 addresses are 4 bytes
-  if (!etherBuffer->writeNet16(6,ARP_RESPONSE)) return false;// 2 is response
-  if (!etherBuffer->write(8,sender_hardware_addr,6)) return false; //sender mac
-  if (!etherBuffer->write(14,ipAddress,4)) return false;   //sender ip
-  
-  //target hw address
-  if (!etherBuffer->write(18,target_hardware_addr,6)) return false;
-  //target ip address   
-  if (!etherBuffer->write(24,target_protocol_addr,4)) return false;
+  Buffer* etherBuffer = etherControl->getSendPayloadBuffer();
 
-  return etherControl->sendFrame(target_hardware_addr,ARP_PROTOCOL,28);
-}//end sendARPResponse
+  Header<ARPHeader> arp;
+  arp.place(etherBuffer);
+  arp.set<ARPHeader::HardwareType>(ETH_PROTOCOL); // 1 for ethernet
+  arp.set<ARPHeader::ProtocolType>(IP_PROTOCOL);  // 0x0800 for IP
+  arp.set<ARPHeader::HardwareLength>(6); // mac addresses are 6 bytes
+  arp.set<ARPHeader::ProtocolLength>(4); // IPv4 addresses are 4 bytes
+  arp.set<ARPHeader::Operation>(operation);
+  arp.set<ARPHeader::SenderMAC>(etherControl->getMACAddress());
+  arp.set<ARPHeader::SenderIP>(ipAddress);
+  arp.set<ARPHeader::TargetMAC>(target_hardware_addr);
+  arp.set<ARPHeader::TargetIP>(target_protocol_addr);
+  if (!arp.store(etherBuffer)) return false;
+
+  return etherControl->sendFrame(destination,ARP_PROTOCOL,ARPHeader::LENGTH);
+}//end sendARPPacket
 
 void ARPHandler::handlePayload(Buffer *p){
 
-  if (p->size() < 28) return; //inbound packet should be at least 28 bytes
-                              //the size of an ARP frame
+  //inbound packet should be at least the size of an ARP frame
+  Header<ARPHeader> arp;
+  if (!arp.load(p)) return;
 
   uint8_t *macAddress = etherControl->getMACAddress();
 
   //we only care about ethernet
-  uint16_t w;
-  if (!p->readNet16(0,&w) || w != ETH_PROTOCOL) return;
+  if (arp.get<ARPHeader::HardwareType>() != ETH_PROTOCOL) return;
  
   //we only care about ip
-  if (!p->readNet16(2,&w) || w != IP_PROTOCOL) return;
+  if (arp.get<ARPHeader::ProtocolType>() != IP_PROTOCOL) return;
 
   //wouldn't know what to do if mac address was not 6 bytess 
-  uint8_t b;
-  if (!p->read8(4,&b) || b != 6) return;  
+  if (arp.get<ARPHeader::HardwareLength>() != 6) return;  
 
   //wouldn't know what to do if ip address was not 4 bytess
-  if (!p->read8(5,&b) || b != 4) return;
+  if (arp.get<ARPHeader::ProtocolLength>() != 4) return;
 
   // get the ARP type
-  uint16_t operation;
-  if (!p->readNet16(6,&operation)) return;
-
-  uint8_t sender_hardware_addr[6];
-  uint8_t sender_protocol_addr[4];
-  uint8_t target_hardware_addr[6];
-  uint8_t target_protocol_addr[4];
-  if (!p->read(8,sender_hardware_addr,6)) return;
-  if (!p->read(14,sender_protocol_addr,4)) return;
-  if (!p->read(18,target_hardware_addr,6)) return;
-  if (!p->read(24,target_protocol_addr,4)) return;
+  uint16_t operation = arp.get<ARPHeader::Operation>();
+
+  //the addresses are read straight out of the header; replies are built
+  //in the send buffer, which is never the one we are reading
+  uint8_t *sender_hardware_addr = (uint8_t*)arp.get<ARPHeader::SenderMAC>();
+  uint8_t *sender_protocol_addr = (uint8_t*)arp.get<ARPHeader::SenderIP>();
+  uint8_t *target_hardware_addr = (uint8_t*)arp.get<ARPHeader::TargetMAC>();
+  uint8_t *target_protocol_addr = (uint8_t*)arp.get<ARPHeader::TargetIP>();
   
   if (operation == ARP_REQUEST){
 
@@ -179,6 +166,12 @@ void ARPHandler::handlePayload(Buffer *p){
   }//end if response
 }//end handlePayload
 
+bool ARPHandler::matchBroadcasts(receivePattern *pattern){
+  EthernetDriver::addToPattern(pattern,EthernetHeader::LENGTH +
+			       ARPHeader::TargetIP::offset,ipAddress,4);
+  return true;
+}//end matchBroadcasts
+
 uint8_t* ARPHandler::getMACAddress(uint8_t *remoteIP){
 
   //try to find the ip in our routing table
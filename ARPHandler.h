@@ -28,11 +28,17 @@ class ARPHandler: PayloadHandler, TimerHandler{
   bool sendARPRequest(uint8_t target_protocol_addr[4]);
   bool sendARPResponse(uint8_t target_hardware_addr[6],
 		       uint8_t target_protocol_addr[4]);
+  bool sendARPPacket(uint16_t operation, const uint8_t* target_hardware_addr,
+		     const uint8_t* target_protocol_addr,
+		     const uint8_t* destination);
 
  public:
   ARPHandler(uint8_t *ipAddress, uint8_t routingTableSize, 
 	     EtherControl *control);
   void handlePayload(Buffer *p);
+
+  //only requests (and replies) aimed at our IP
+  bool matchBroadcasts(receivePattern *pattern);
   uint8_t* getMACAddress(uint8_t *remoteIP);
   bool requestMACAddress(uint8_t *remoteIP);
   void handleTimer(uint8_t timer);
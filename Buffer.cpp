@@ -1,6 +1,18 @@
 #include <hostutil.h>
 #include <string.h>
 #include "Buffer.h"
+#include "MemBuffer.h"
+#include "OffsetBuffer.h"
+
+//the stack buffers partialChecksum and copyTo move data through;
+//CHECKSUM_BLOCK must be even
+#if defined(ARDUINO)
+#define CHECKSUM_BLOCK 32
+#define COPY_BLOCK 32
+#else
+#define CHECKSUM_BLOCK 256
+#define COPY_BLOCK 256
+#endif
 
 bool Buffer::write(uint16_t offset, const char* d){
   return this->write(offset,d,strlen(d));
@@ -63,11 +75,28 @@ bool Buffer::copyTo(Buffer* destination, uint16_t dest_start,
   if (src_start + len > size()) return false;
   if (dest_start + len > destination->size()) return false; 
 
-  for(uint16_t offset = 0; offset < len; offset++){
-    uint8_t d;
-    if (!this->read8(src_start+offset,&d)) return false;
-    if (!destination->write8(dest_start+offset,d)) return false;
-  }//end for
+  //a MemBuffer can read the data straight into its memory, and an
+  //OffsetBuffer hands the copy to the buffer underneath it (which may
+  //turn out to be us)
+  if (destination->getBufferType() == MemBuffer::BufferType ||
+      destination->getBufferType() == OffsetBuffer::BufferType)
+    return destination->copyFrom(this,dest_start,src_start,len);
+
+  //move the data a block at a time through the stack.  When copying
+  //within a buffer to a higher offset, go backwards so that we never
+  //overwrite data we have yet to read
+  uint8_t block[COPY_BLOCK];
+  bool backwards = destination == this && dest_start > src_start;
+  uint16_t done = 0;
+  while (done < len){
+    uint16_t n = len - done;
+    if (n > COPY_BLOCK) n = COPY_BLOCK;
+    uint16_t offset = backwards ? len - done - n : done;
+
+    if (!this->read(src_start+offset,block,n)) return false;
+    if (!destination->write(dest_start+offset,block,n)) return false;
+    done += n;
+  }//end while
 
   return true;
 }//end copyTo
@@ -77,6 +106,129 @@ bool Buffer::copyFrom(Buffer* source, uint16_t dest_start,
   return source->copyTo(this,dest_start,src_start,len);
 }//end copyFrom
 
+uint32_t Buffer::sumWords(const uint8_t* data, uint16_t len, uint32_t sum){
+
+#if defined(ARDUINO)
+  //8 bit cpu: simply add each big endian word
+  uint16_t words = len >> 1;
+  while (words--){
+    sum += ((uint16_t)data[0] << 8) | data[1];
+    data += 2;
+  }
+#else
+  //add 32 bits at a time in host byte order into a 64 bit accumulator,
+  //then fold and swap to network order at the end.  The one's complement
+  //sum does not depend on byte order, so the result is the same
+  uint64_t acc = 0;
+  uint32_t w[8];
+  while (len >= 32){
+    memcpy(w,data,32);
+    acc += (uint64_t)w[0] + w[1] + w[2] + w[3] + w[4] + w[5] + w[6] + w[7];
+    data += 32;
+    len -= 32;
+  }
+  while (len >= 4){
+    memcpy(w,data,4);
+    acc += w[0];
+    data += 4;
+    len -= 4;
+  }
+  if (len >= 2){
+    uint16_t h;
+    memcpy(&h,data,2);
+    acc += h;
+    data += 2;
+    len -= 2;
+  }
+
+  while (acc >> 16)
+    acc = (acc & 0xFFFF) + (acc >> 16);
+  sum += NTOHS((uint16_t)acc);
+#endif
+
+  //an odd byte is the high byte of a word padded with zero
+  if (len & 1)
+    sum += (uint16_t)data[0] << 8;
+
+  //keep the carries from piling up over many calls
+  return (sum & 0xFFFF) + (sum >> 16);
+}
+
+uint32_t Buffer::partialChecksum(uint16_t offset, uint16_t len, uint32_t sum){
+  uint8_t block[CHECKSUM_BLOCK];
+
+  while (len > 0){
+    uint16_t n = len < CHECKSUM_BLOCK ? len : CHECKSUM_BLOCK;
+    if (!this->read(offset,block,n)) break;
+    sum = sumWords(block,n,sum);
+    offset += n;
+    len -= n;
+  }
+
+  return sum;
+}
+
+bool Buffer::copyToAndSum(Buffer* destination, uint16_t dest_start,
+			  uint16_t src_start, uint16_t len, uint32_t* sum){
+
+  if (src_start + len > size()) return false;
+  if (dest_start + len > destination->size()) return false;
+
+  //if we are in memory, sum the bytes here as they are written out
+  uint8_t* data = this->span(src_start,len);
+  if (data != NULL){
+    if (!destination->write(dest_start,data,len)) return false;
+    *sum = sumWords(data,len,*sum);
+    return true;
+  }
+
+  //if the destination is in memory, sum them once they have arrived
+  data = destination->span(dest_start,len);
+  if (data != NULL){
+    if (!this->read(src_start,data,len)) return false;
+    *sum = sumWords(data,len,*sum);
+    return true;
+  }
+
+  //otherwise leave each step to the buffers; a device that can move
+  //data internally may well copy without the bytes leaving it
+  if (!this->copyTo(destination,dest_start,src_start,len)) return false;
+  *sum = this->partialChecksum(src_start,len,*sum);
+  return true;
+}//end copyToAndSum
+
+uint8_t* Buffer::span(uint16_t offset, uint16_t len){
+  return NULL;
+}
+
+uint8_t* Buffer::load(uint16_t offset, uint16_t len, uint8_t* scratch){
+  uint8_t* p = span(offset,len);
+  if (p != NULL) return p;
+  if (!read(offset,scratch,len)) return NULL;
+  return scratch;
+}
+
+//HC' = ~(~HC + ~m + m')  (RFC 1624, eqn. 3)
+uint16_t Buffer::adjustChecksum(uint16_t checksum, uint16_t oldValue,
+				uint16_t newValue){
+  if (oldValue == newValue) return checksum;
+
+  uint32_t sum = (uint16_t)~checksum;
+  sum += (uint16_t)~oldValue;
+  sum += newValue;
+
+  while (sum >> 16)
+    sum = (sum & 0xFFFF) + (sum >> 16);
+
+  return (uint16_t)~sum;
+}
+
+uint16_t Buffer::adjustChecksum32(uint16_t checksum, uint32_t oldValue,
+				  uint32_t newValue){
+  checksum = adjustChecksum(checksum,oldValue >> 16,newValue >> 16);
+  return adjustChecksum(checksum,oldValue & 0xFFFF,newValue & 0xFFFF);
+}
+
 uint16_t Buffer::checksum(uint16_t len, 
 			  uint16_t checksum_offset,
 			  uint32_t pseudo){
@@ -84,23 +236,17 @@ uint16_t Buffer::checksum(uint16_t len,
   uint32_t sum = pseudo;  
 
   if (len > this->size()) len = this->size();
-  
-  for(int i=0; i < len; i+=2){
-    
-    //the checksum is stored at offset 16, so we will skip it
-    if (i==checksum_offset) continue;
-
-    uint16_t value = 0x0000;
-    if (i+1 < len)
-      this->readNet16(i,&value);
-    else{
-      uint8_t v8;
-      this->read8(i,&v8);
-      value = (v8 & 0x00FF);
-      value = NTOHS(value);
-    }
-    sum += value;
+
+  //sum either side of the checksum field, which must be word aligned
+  //to be skipped
+  if ((checksum_offset & 1) == 0 && checksum_offset < len){
+    sum = partialChecksum(0,checksum_offset,sum);
+    if (checksum_offset + 2 < len)
+      sum = partialChecksum(checksum_offset + 2,
+			    len - checksum_offset - 2,sum);
   }
+  else
+    sum = partialChecksum(0,len,sum);
   
   //The sum is two 16 bit words
   //keep summing them together until the sum is 16 bits or less
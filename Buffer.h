@@ -34,6 +34,60 @@ class Buffer {
   uint16_t checksum(uint16_t len, uint16_t checksum_offset, 
 		    uint32_t pseudo = 0);
 
+  //add the 16 bit words of len bytes starting at offset to sum (an odd
+  //trailing byte is padded with zero) and return the new, unfolded sum.
+  //The default reads the buffer a block at a time; buffers that hold
+  //their data in memory override it to sum in place
+  virtual uint32_t partialChecksum(uint16_t offset, uint16_t len,
+				   uint32_t sum = 0);
+
+  //the same over a block of memory; this is the inner checksum loop
+  static uint32_t sumWords(const uint8_t* data, uint16_t len,
+			   uint32_t sum = 0);
+
+  //copy len bytes to destination as copyTo does, adding them to *sum as
+  //partialChecksum(src_start,len) would.  Bytes are summed on whichever
+  //side of the copy is in memory, so a device buffer is not read again
+  //just to be checksummed
+  virtual bool copyToAndSum(Buffer* destination, uint16_t dest_start,
+			    uint16_t src_start, uint16_t len, uint32_t* sum);
+
+  //update a checksum (as written to the packet) for a field that has
+  //changed from oldValue to newValue without summing the packet again.
+  //See RFC 1624.  Values are in host byte order
+  static uint16_t adjustChecksum(uint16_t checksum, uint16_t oldValue,
+				 uint16_t newValue);
+  static uint16_t adjustChecksum32(uint16_t checksum, uint32_t oldValue,
+				   uint32_t newValue);
+
+  //a pointer to len bytes starting at offset if the buffer keeps them in
+  //ordinary memory, otherwise NULL (the bytes are on a device, or the
+  //range is out of bounds).  Anything written through the pointer goes
+  //straight into the buffer.  The pointer is good until the buffer is
+  //next reinitialised or destroyed
+  virtual uint8_t* span(uint16_t offset, uint16_t len);
+
+  //span() where there is one; otherwise read the bytes into scratch
+  //(which must hold len bytes) and return that.  NULL if the range is
+  //out of bounds.  Use it to parse a header with plain loads
+  uint8_t* load(uint16_t offset, uint16_t len, uint8_t* scratch);
+
+  //network order loads and stores for headers reached through span()
+  //or load()
+  static inline uint16_t getNet16(const uint8_t* p){
+    return ((uint16_t)p[0] << 8) | p[1];
+  }
+  static inline uint32_t getNet32(const uint8_t* p){
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+      ((uint32_t)p[2] << 8) | p[3];
+  }
+  static inline void putNet16(uint8_t* p, uint16_t d){
+    p[0] = d >> 8; p[1] = d;
+  }
+  static inline void putNet32(uint8_t* p, uint32_t d){
+    p[0] = d >> 24; p[1] = d >> 16; p[2] = d >> 8; p[3] = d;
+  }
+
   //compiling GCC with -fno-rtti will remove
   //getType() from C++ classes and will disable
   //the ability to do a dynamic_cast.
@@ -0,0 +1,290 @@
+#include <string.h>
+#include "BufferChain.h"
+#include "OffsetBuffer.h"
+
+BufferChain::BufferChain(){
+  clear();
+}
+
+void BufferChain::clear(){
+  this->segmentCount = 0;
+  this->length = 0;
+}
+
+uint8_t BufferChain::getSegmentCount(){
+  return this->segmentCount;
+}
+
+uint16_t BufferChain::size(){
+  return this->length;
+}
+
+bool BufferChain::add(bool front, Buffer* buffer, uint8_t* data,
+		      uint16_t offset, uint16_t len){
+  if (len == 0) return true;
+  if ((uint32_t)this->length + len > 0xFFFF) return false;
+
+  //carry on from the neighbouring piece if this one runs into it
+  if (segmentCount > 0){
+    bufferSegment* s = &segments[front ? 0 : segmentCount-1];
+    if (front){
+      if ((buffer == NULL && s->buffer == NULL && data + len == s->data) ||
+	  (buffer != NULL && s->buffer == buffer && offset + len == s->offset)){
+	s->data = data;
+	s->offset = offset;
+	s->len += len;
+	this->length += len;
+	return true;
+      }
+    }
+    else {
+      if ((buffer == NULL && s->buffer == NULL && s->data + s->len == data) ||
+	  (buffer != NULL && s->buffer == buffer && s->offset + s->len == offset)){
+	s->len += len;
+	this->length += len;
+	return true;
+      }
+    }
+  }
+
+  if (segmentCount >= BUFFERCHAIN_SEGMENTS) return false;
+
+  bufferSegment* s = &segments[segmentCount];
+  if (front){
+    memmove(segments+1,segments,segmentCount*sizeof(bufferSegment));
+    s = &segments[0];
+  }
+  segmentCount++;
+
+  s->buffer = buffer;
+  s->data = data;
+  s->offset = offset;
+  s->len = len;
+  this->length += len;
+  return true;
+}
+
+bool BufferChain::insert(bool front, Buffer* buffer, uint16_t offset,
+			 uint16_t len){
+
+  uint16_t bufferSize = buffer->size();
+  if (offset > bufferSize) return false;
+  if (len == 0) len = bufferSize - offset;
+  if (offset + len > bufferSize) return false;
+  if (len == 0) return true;
+
+  //memory is best dealt with directly
+  uint8_t* data = buffer->span(offset,len);
+  if (data != NULL)
+    return add(front,NULL,data,0,len);
+
+  uint8_t type = buffer->getBufferType();
+
+  //the pieces of another chain are added one at a time, last first
+  //when they go on the front
+  if (type == BufferChain::BufferType){
+    BufferChain* chain = static_cast<BufferChain*>(buffer);
+    bufferSegment pieces[BUFFERCHAIN_SEGMENTS];
+    uint8_t count = 0;
+    uint16_t o;
+    uint8_t i = chain->locate(offset,&o);
+    while (len > 0){
+      bufferSegment* s = &chain->segments[i++];
+      bufferSegment* p = &pieces[count++];
+      p->len = s->len - o;
+      if (p->len > len) p->len = len;
+      p->buffer = s->buffer;
+      p->data = s->data == NULL ? NULL : s->data + o;
+      p->offset = s->offset + o;
+      len -= p->len;
+      o = 0;
+    }
+    //all or nothing; put things back if we run out of segments
+    uint8_t savedCount = segmentCount;
+    uint16_t savedLength = length;
+    bufferSegment saved[BUFFERCHAIN_SEGMENTS];
+    memcpy(saved,segments,sizeof(segments));
+    for(i=0; i<count; i++){
+      bufferSegment* p = &pieces[front ? count-1-i : i];
+      if (!add(front,p->buffer,p->data,p->offset,p->len)){
+	memcpy(segments,saved,sizeof(segments));
+	segmentCount = savedCount;
+	length = savedLength;
+	return false;
+      }
+    }
+    return true;
+  }
+
+  //record anything else against the buffer that really holds it
+  if (type == OffsetBuffer::BufferType){
+    OffsetBuffer* ob = static_cast<OffsetBuffer*>(buffer);
+    return add(front,ob->getRootBuffer(),NULL,
+	       ob->getRootBufferOffset()+offset,len);
+  }
+
+  return add(front,buffer,NULL,offset,len);
+}
+
+bool BufferChain::append(Buffer* buffer, uint16_t offset, uint16_t len){
+  return insert(false,buffer,offset,len);
+}
+
+bool BufferChain::append(uint8_t* data, uint16_t len){
+  return add(false,NULL,data,0,len);
+}
+
+bool BufferChain::prepend(Buffer* buffer, uint16_t offset, uint16_t len){
+  return insert(true,buffer,offset,len);
+}
+
+bool BufferChain::prepend(uint8_t* data, uint16_t len){
+  return add(true,NULL,data,0,len);
+}
+
+//the segment holding the byte at offset, and where it is in the segment
+uint8_t BufferChain::locate(uint16_t offset, uint16_t* segmentOffset){
+  uint8_t i = 0;
+  while (i < segmentCount - 1 && offset >= segments[i].len){
+    offset -= segments[i].len;
+    i++;
+  }
+  *segmentOffset = offset;
+  return i;
+}
+
+bool BufferChain::read(uint16_t offset, void* data, uint16_t len){
+  if (offset + len > this->size()) return false;
+  if (len == 0) return true;
+
+  uint8_t* d = (uint8_t*)data;
+  uint16_t o;
+  uint8_t i = locate(offset,&o);
+  while (len > 0){
+    bufferSegment* s = &segments[i++];
+    uint16_t n = s->len - o;
+    if (n > len) n = len;
+    if (s->buffer == NULL)
+      memmove(d,s->data+o,n);
+    else if (!s->buffer->read(s->offset+o,d,n))
+      return false;
+    d += n;
+    len -= n;
+    o = 0;
+  }
+  return true;
+}
+
+bool BufferChain::write(uint16_t offset, const void* data, uint16_t len){
+  if (offset + len > this->size()) return false;
+  if (len == 0) return true;
+
+  const uint8_t* d = (const uint8_t*)data;
+  uint16_t o;
+  uint8_t i = locate(offset,&o);
+  while (len > 0){
+    bufferSegment* s = &segments[i++];
+    uint16_t n = s->len - o;
+    if (n > len) n = len;
+    if (s->buffer == NULL)
+      memmove(s->data+o,d,n);
+    else if (!s->buffer->write(s->offset+o,d,n))
+      return false;
+    d += n;
+    len -= n;
+    o = 0;
+  }
+  return true;
+}
+
+bool BufferChain::copyTo(Buffer* destination, uint16_t dest_start,
+			 uint16_t src_start, uint16_t len){
+
+  if (len == 0){
+    len = size();
+    if (destination->size() < len) len = destination->size();
+  }
+
+  if (src_start + len > size()) return false;
+  if (dest_start + len > destination->size()) return false;
+  if (len == 0) return true;
+
+  //where the destination really is, so we can tell which pieces are
+  //already in place
+  Buffer* root = destination;
+  uint16_t rootOffset = 0;
+  if (destination->getBufferType() == OffsetBuffer::BufferType){
+    OffsetBuffer* ob = static_cast<OffsetBuffer*>(destination);
+    root = ob->getRootBuffer();
+    rootOffset = ob->getRootBufferOffset();
+  }
+
+  uint16_t o;
+  uint8_t i = locate(src_start,&o);
+  while (len > 0){
+    bufferSegment* s = &segments[i++];
+    uint16_t n = s->len - o;
+    if (n > len) n = len;
+
+    if (s->buffer == NULL){
+      if (destination->span(dest_start,n) != s->data+o &&
+	  !destination->write(dest_start,s->data+o,n))
+	return false;
+    }
+    else if (s->buffer != root || s->offset+o != rootOffset+dest_start){
+      if (!s->buffer->copyTo(destination,dest_start,s->offset+o,n))
+	return false;
+    }
+
+    dest_start += n;
+    len -= n;
+    o = 0;
+  }
+  return true;
+}//end copyTo
+
+//each piece is summed as though it started on a word boundary; a piece
+//that really starts half way through a word has its sum byte swapped,
+//which is the same thing in one's complement arithmetic (RFC 1071)
+uint32_t BufferChain::partialChecksum(uint16_t offset, uint16_t len,
+				      uint32_t sum){
+  if (offset + len > this->size()) return sum;
+  if (len == 0) return sum;
+
+  bool odd = false;
+  uint16_t o;
+  uint8_t i = locate(offset,&o);
+  while (len > 0){
+    bufferSegment* s = &segments[i++];
+    uint16_t n = s->len - o;
+    if (n > len) n = len;
+
+    uint32_t part;
+    if (s->buffer == NULL)
+      part = sumWords(s->data+o,n);
+    else
+      part = s->buffer->partialChecksum(s->offset+o,n);
+    while (part >> 16)
+      part = (part & 0xFFFF) + (part >> 16);
+    if (odd)
+      part = ((part & 0xFF) << 8) | (part >> 8);
+    sum += part;
+
+    if (n & 1) odd = !odd;
+    len -= n;
+    o = 0;
+  }
+  return sum;
+}
+
+uint8_t* BufferChain::span(uint16_t offset, uint16_t len){
+  if (offset + len > this->size() || len == 0) return NULL;
+
+  uint16_t o;
+  bufferSegment* s = &segments[locate(offset,&o)];
+  if (o + len > s->len) return NULL;
+  if (s->buffer == NULL) return s->data + o;
+  return s->buffer->span(s->offset+o,len);
+}
+
+uint8_t BufferChain::getBufferType() { return BufferChain::BufferType; }
@@ -0,0 +1,86 @@
+/*
+ *  A Buffer made of pieces of other buffers and blocks of memory, read
+ *  and written as though they were one.  It lets a packet be sent
+ *  without first copying its payload in behind its headers:
+ *
+ *     BufferChain datagram;
+ *     datagram.append(payload,payloadLength);  //data in the application
+ *     datagram.prepend(headerBuffer,0,8);      //header in the send buffer
+ *
+ *  Nothing is copied when a piece is added; the chain only remembers
+ *  where the piece is, so the buffers and memory must stay put until the
+ *  chain has been sent.  The driver gathers the pieces into the frame as
+ *  it transmits (see EthernetDriver::sendGatheredFrame).
+ *
+ *  Pieces of an OffsetBuffer or a BufferChain are recorded against the
+ *  buffer underneath, pieces of a buffer that keeps its data in memory
+ *  (see Buffer::span) as plain memory, and pieces that run into the
+ *  piece next to them are merged.  A chain holds up to
+ *  BUFFERCHAIN_SEGMENTS pieces after merging.
+ */
+#ifndef BUFFERCHAIN_H
+#define BUFFERCHAIN_H
+
+#include <stdint.h>
+#include <Buffer.h>
+
+#define BUFFERCHAIN_SEGMENTS 4
+
+typedef struct bufferSegment {
+  Buffer* buffer;    //NULL when the piece is in memory
+  uint8_t* data;     //the memory, when buffer is NULL
+  uint16_t offset;   //the start of the piece in buffer
+  uint16_t len;
+} bufferSegment;
+
+class BufferChain: public Buffer {
+
+  bufferSegment segments[BUFFERCHAIN_SEGMENTS];
+  uint8_t segmentCount;
+  uint16_t length;
+
+  bool add(bool front, Buffer* buffer, uint8_t* data, uint16_t offset,
+	   uint16_t len);
+  bool insert(bool front, Buffer* buffer, uint16_t offset, uint16_t len);
+  uint8_t locate(uint16_t offset, uint16_t* segmentOffset);
+
+ public:
+  BufferChain();
+
+  //forget every piece
+  void clear();
+
+  //add len bytes of buffer starting at offset to the end of the chain
+  //(len 0 for the rest of the buffer).  False if the range is out of
+  //bounds or the chain is full
+  bool append(Buffer* buffer, uint16_t offset = 0, uint16_t len = 0);
+
+  //add len bytes of memory to the end of the chain
+  bool append(uint8_t* data, uint16_t len);
+
+  //the same, but to the front of the chain.  Each protocol layer puts
+  //its header on the front of the chain it was handed, which costs
+  //nothing when the headers sit next to each other in the send buffer
+  bool prepend(Buffer* buffer, uint16_t offset = 0, uint16_t len = 0);
+  bool prepend(uint8_t* data, uint16_t len);
+
+  uint8_t getSegmentCount();
+
+  uint16_t size();
+
+  bool write(uint16_t offset, const void* data, uint16_t len);
+  bool read(uint16_t offset, void* data, uint16_t len);
+
+  //each piece is copied by the buffer that holds it; pieces that are
+  //already where they are being copied to are skipped
+  bool copyTo(Buffer* destination, uint16_t dest_start = 0,
+	      uint16_t src_start = 0, uint16_t len = 0);
+
+  uint32_t partialChecksum(uint16_t offset, uint16_t len, uint32_t sum = 0);
+  uint8_t* span(uint16_t offset, uint16_t len);
+
+  uint8_t getBufferType();
+  const static uint8_t BufferType = 4;
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "BufferedSocket.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 void BufferedSocket::init(uint16_t bufferCapacity){
@@ -32,8 +33,7 @@ BufferedSocket::~BufferedSocket(){
   if (recvBuffer != NULL)
     free(recvBuffer);
 }
-  
-#include <Arduino.h>
+
 bool BufferedSocket::onDataReceived(Buffer* buf){
 
   if ((this->bufferSize + buf->size()) > this->bufferCapacity)
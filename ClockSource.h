@@ -0,0 +1,15 @@
+#ifndef CLOCKSOURCE_H
+#define CLOCKSOURCE_H
+
+#include <stdint.h>
+
+//a source of milliseconds for Host::getMillis() (and therefore
+//host_millis()).  See Host::setClockSource and SimulatedClock
+class ClockSource {
+
+ public:
+  virtual uint32_t getMillis() = 0;
+
+};
+
+#endif
@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <hostutil.h>
+#include <Headers.h>
 #include "IPHandler.h"
 #include "UDPHandler.h"
 #include "DNSHandler.h"
@@ -42,10 +43,13 @@ DNSHandler::DNSHandler(UDPHandler* udpHandler,uint8_t *dnsip,
   this->cache = (dnsLookup*)malloc(sizeof(dnsLookup)*cacheCapacity);
   if (this->cache != NULL)
     this->cacheCapacity = cacheCapacity;
+  else
+    this->cacheCapacity = 0;
 
+  //the domain names are allocated as entries are used
   for(int i=0; i<this->cacheCapacity; i++){
-    cache[i].domainName[0] = '\0';
-    memcpy(cache[i].ipAddress,0,4);
+    cache[i].domainName = NULL;
+    memset(cache[i].ipAddress,0,4);
     cache[i].status = INIT | NO_ERROR;
   }
 
@@ -81,12 +85,15 @@ bool DNSHandler::sendDNSRequest(const char* domainName, uint16_t id,
   }
 
   //populate the DNS header
-  if (!udpBuffer->writeNet16( 0,    id)) return false;  //id
-  if (!udpBuffer->writeNet16( 2,0x0100)) return false;  //control:see rfc1035
-  if (!udpBuffer->writeNet16( 4,0x0001)) return false;  //qdcount:just 1 lookup
-  if (!udpBuffer->writeNet16( 6,0x0000)) return false;  //ancount:0
-  if (!udpBuffer->writeNet16( 8,0x0000)) return false;  //nscount:0
-  if (!udpBuffer->writeNet16(10,0x0000)) return false;  //arcount:0
+  Header<DNSHeader> dns;
+  dns.place(udpBuffer);
+  dns.set<DNSHeader::ID>(id);
+  dns.set<DNSHeader::Control>(0x0100);       //see rfc1035
+  dns.set<DNSHeader::QuestionCount>(0x0001); //just 1 lookup
+  dns.set<DNSHeader::AnswerCount>(0x0000);
+  dns.set<DNSHeader::AuthorityCount>(0x0000);
+  dns.set<DNSHeader::AdditionalCount>(0x0000);
+  if (!dns.store(udpBuffer)) return false;
 
   uint16_t length = DNS_HEADER_LENGTH;
 
@@ -265,13 +272,16 @@ void DNSHandler::handleDatagram(uint8_t* sourceIP, uint16_t sourcePort,
       !IPHandler::ipsEquate(sourceIP,dnsIPBackup))
     return;
 
+  Header<DNSHeader> dns;
+  if (!dns.load(packet)) return;
+
   dns_header header;
-  if (!packet->readNet16( 0,&header.id))      return;
-  if (!packet->readNet16( 2,&header.control)) return;
-  if (!packet->readNet16( 4,&header.qdcount)) return;
-  if (!packet->readNet16( 6,&header.ancount)) return;
-  if (!packet->readNet16( 8,&header.nscount)) return;
-  if (!packet->readNet16(10,&header.arcount)) return;
+  header.id      = dns.get<DNSHeader::ID>();
+  header.control = dns.get<DNSHeader::Control>();
+  header.qdcount = dns.get<DNSHeader::QuestionCount>();
+  header.ancount = dns.get<DNSHeader::AnswerCount>();
+  header.nscount = dns.get<DNSHeader::AuthorityCount>();
+  header.arcount = dns.get<DNSHeader::AdditionalCount>();
   
   //check to make sure this is a response
   if (header.control >> 15 != 0x01) 
@@ -8,6 +8,8 @@
  *  automatically wrap around to the startAddress.
  */
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include "ENC28J60Buffer.h"
 
 ENC28J60Buffer::ENC28J60Buffer(ENC28J60Driver* driver,
@@ -22,46 +24,203 @@ ENC28J60Buffer::ENC28J60Buffer(ENC28J60Driver* driver,
   this->wrap = wrap;
   this->payloadPointer = payloadPointer;
   this->len = len;
+  this->dataLength = 0;
+  this->cache = NULL;
+  this->cacheCapacity = 0;
+  this->cacheLength = 0;
+  this->cacheOffset = 0;
+  resetReadAheadCounters();
+  this->stage = NULL;
+  this->stageCapacity = 0;
+  this->stageLength = 0;
+  this->stageOffset = 0;
 }
 
 uint16_t ENC28J60Buffer::size(){
   return len;
 }
 
-#include <stdio.h>
-bool ENC28J60Buffer::write(uint16_t offset, const void* data, uint16_t len){
-
-  uint16_t address = this->bufferStart+this->payloadPointer+offset;
+//the controller address of offset; false if it is out of bounds
+bool ENC28J60Buffer::deviceAddress(uint16_t offset, uint16_t* address){
+  *address = this->bufferStart+this->payloadPointer+offset;
   
   //if the offset address is beyond the ending address
-  if (address > this->bufferEnd){
+  if (*address > this->bufferEnd){
     if (!wrap) 
       return false;
     else
-      address = (address-this->bufferEnd)+this->bufferStart-1;
+      *address = (*address-this->bufferEnd)+this->bufferStart-1;
   }
+  return true;
+}
+
+#include <stdio.h>
+bool ENC28J60Buffer::write(uint16_t offset, const void* data, uint16_t len){
+
+  uint16_t address;
+  if (!deviceAddress(offset,&address)) return false;
+
+  //keep the read-ahead window in step with what we write
+  if (cacheLength > 0 && offset < cacheOffset + cacheLength &&
+      offset + len > cacheOffset)
+    cacheLength = 0;
+
+  if (len == 0) return true;
+
+  if (len <= stageCapacity){
+    //join the write to what is staged if the two touch or overlap and
+    //fit in the stage together; otherwise send the stage on its way
+    //and start again with this write
+    if (stageLength > 0){
+      uint16_t start = offset < stageOffset ? offset : stageOffset;
+      uint16_t end = stageOffset + stageLength;
+      if (offset + len > end) end = offset + len;
+      if (offset > stageOffset + stageLength || offset + len < stageOffset ||
+	  end - start > stageCapacity){
+	if (!flush()) return false;
+      }
+      else {
+	if (start < stageOffset){
+	  memmove(stage+(stageOffset-start),stage,stageLength);
+	  stageOffset = start;
+	}
+	memcpy(stage+(offset-stageOffset),data,len);
+	stageLength = end - start;
+	return true;
+      }
+    }
+    memcpy(stage,data,len);
+    stageOffset = offset;
+    stageLength = len;
+    return true;
+  }
+
+  //large writes go straight out, after anything staged underneath them
+  if (stageLength > 0 && offset < stageOffset + stageLength &&
+      offset + len > stageOffset && !flush())
+    return false;
 
   return driver->write(address, (uint8_t*)data, len);  
 }
 
-bool ENC28J60Buffer::read(uint16_t offset, void* data, uint16_t len){
-  uint16_t address = this->bufferStart+this->payloadPointer+offset;
-  
-  //if the offset address is beyond the ending address
-  if (address > this->bufferEnd){
-    if (!wrap) 
-      return false;
-    else
-      address = (address-this->bufferEnd)+this->bufferStart-1;
+bool ENC28J60Buffer::flush(){
+  if (stageLength == 0) return true;
+
+  uint16_t address;
+  uint8_t n = stageLength;
+  stageLength = 0;
+  if (!deviceAddress(stageOffset,&address)) return false;
+  return driver->write(address,stage,n);
+}
+
+bool ENC28J60Buffer::fetch(uint16_t offset, uint8_t* data, uint16_t len){
+  uint16_t address;
+  if (!deviceAddress(offset,&address)) return false;
+
+  //bytes still in the stage are read back from it (a checksum of what
+  //was just written, say); a read that only partly overlaps it has to
+  //wait for the stage to reach the controller
+  if (stageLength > 0 && offset >= stageOffset &&
+      offset + len <= stageOffset + stageLength){
+    memcpy(data,stage+(offset-stageOffset),len);
+    return true;
   }
+  if (stageLength > 0 && offset < stageOffset + stageLength &&
+      offset + len > stageOffset && !flush())
+    return false;
   
-  return driver->read(address, (uint8_t*)data, len);
+  return driver->read(address, data, len);
+}
+
+bool ENC28J60Buffer::read(uint16_t offset, void* data, uint16_t len){
+
+  //the window stops where the data does, so refills near the end of
+  //a short frame don't clock in ring memory that isn't part of it
+  uint16_t limit = dataLength > 0 ? dataLength : this->len;
+
+  //large reads, and reads past the end of the data, are not cached
+  if (cacheCapacity == 0 || len > cacheCapacity || offset + len > limit)
+    return fetch(offset,(uint8_t*)data,len);
+
+  if (offset >= cacheOffset && 
+      offset + len <= cacheOffset + cacheLength){
+    cacheHits++;
+  }
+  else {
+    //refill the window starting at this read
+    cacheMisses++;
+    uint16_t n = limit - offset;
+    if (n > cacheCapacity) n = cacheCapacity;
+    cacheLength = 0;
+    if (!fetch(offset,cache,n)) return false;
+    cacheOffset = offset;
+    cacheLength = n;
+  }
+
+  memcpy(data,cache+(offset-cacheOffset),len);
+  return true;
+}
+
+void ENC28J60Buffer::setReadAhead(uint8_t bytes){
+  free(this->cache);
+  this->cache = NULL;
+  this->cacheCapacity = 0;
+  this->cacheLength = 0;
+
+  if (bytes == 0) return;
+  this->cache = (uint8_t*)malloc(bytes);
+  if (this->cache != NULL)
+    this->cacheCapacity = bytes;
+}
+
+uint8_t ENC28J60Buffer::getReadAhead(){
+  return this->cacheCapacity;
+}
+
+uint32_t ENC28J60Buffer::getReadAheadHits(){
+  return this->cacheHits;
+}
+
+uint32_t ENC28J60Buffer::getReadAheadMisses(){
+  return this->cacheMisses;
+}
+
+void ENC28J60Buffer::resetReadAheadCounters(){
+  this->cacheHits = 0;
+  this->cacheMisses = 0;
+}
+
+void ENC28J60Buffer::setWriteCombining(uint8_t bytes){
+  flush();
+  free(this->stage);
+  this->stage = NULL;
+  this->stageCapacity = 0;
+
+  if (bytes == 0) return;
+  this->stage = (uint8_t*)malloc(bytes);
+  if (this->stage != NULL)
+    this->stageCapacity = bytes;
+}
+
+uint8_t ENC28J60Buffer::getWriteCombining(){
+  return this->stageCapacity;
 }
 
 uint8_t ENC28J60Buffer::getBufferType() { return ENC28J60Buffer::BufferType; }
 
-void ENC28J60Buffer::setPayloadPointer(uint16_t offset){
+void ENC28J60Buffer::relocate(uint16_t startAddress, uint16_t endAddress){
+  flush();
+  this->bufferStart = startAddress;
+  this->bufferEnd = endAddress;
+  this->cacheLength = 0;
+}
+
+void ENC28J60Buffer::setPayloadPointer(uint16_t offset,
+				       uint16_t dataLength){
+  flush();
   this->payloadPointer = offset;
+  this->dataLength = dataLength;
+  this->cacheLength = 0;
 }
 
 bool ENC28J60Buffer::copyTo(Buffer* dest,uint16_t dest_start, 
@@ -103,13 +262,49 @@ bool ENC28J60Buffer::copyTo(Buffer* dest,uint16_t dest_start,
     //then return false to indicate a failure of the copy
     if (dst_address + len - 1 > deb->bufferEnd) return false;
     
-    return driver->copy(src_address,dst_address,len);
+    //the copy goes around the destination's read-ahead window and
+    //comes after anything either side has staged
+    deb->cacheLength = 0;
+    if (!this->flush() || !deb->flush()) return false;
+
+    //the copy carries on while we get on with something else; the
+    //driver waits for it when its bytes are next needed
+    return driver->startCopy(src_address,dst_address,len);
   }
 
   //else handle this like a normal buffer
   return Buffer::copyTo(dest,dest_start,src_start,len);
 }
 
+uint32_t ENC28J60Buffer::partialChecksum(uint16_t offset, uint16_t len,
+					 uint32_t sum){
+  uint16_t address;
+  uint16_t checksum;
+
+  if (len >= ENC28J60_DMA_CHECKSUM_MIN && offset + len <= this->len &&
+      deviceAddress(offset,&address) && flush() &&
+      driver->checksum(address,len,&checksum))
+    //the complement of a checksum is the folded sum it came from
+    return sum + (uint16_t)~checksum;
+
+  return Buffer::partialChecksum(offset,len,sum);
+}
+
+//the source is summed first, so that a copy within the controller can
+//carry on in the background once it has been started
+bool ENC28J60Buffer::copyToAndSum(Buffer* destination, uint16_t dest_start,
+				  uint16_t src_start, uint16_t len,
+				  uint32_t* sum){
+  if (destination->span(dest_start,len) != NULL)
+    return Buffer::copyToAndSum(destination,dest_start,src_start,len,sum);
+
+  if (src_start + len > size()) return false;
+  uint32_t s = partialChecksum(src_start,len,*sum);
+  if (!copyTo(destination,dest_start,src_start,len)) return false;
+  *sum = s;
+  return true;
+}
+
 bool ENC28J60Buffer::copyFrom(Buffer* source, uint16_t dest_start,
 			      uint16_t src_start, uint16_t len){
   return source->copyTo(this,dest_start,src_start,len);
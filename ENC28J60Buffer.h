@@ -7,6 +7,26 @@
 class ENC28J60Driver;
 #include "ENC28J60Driver.h"
 
+//the number of bytes of each received frame the driver keeps in SRAM
+//to answer small reads from (0 turns it off).  64 bytes covers the
+//ethernet, IP and TCP headers along with a TCP option or two
+#ifndef ENC28J60_READAHEAD
+#define ENC28J60_READAHEAD 64
+#endif
+
+//the number of bytes of small writes to the send buffer the driver
+//gathers in SRAM before writing them to the controller (0 turns it
+//off).  64 bytes holds the ethernet, IP and TCP headers of a frame
+#ifndef ENC28J60_WRITECOMBINE
+#define ENC28J60_WRITECOMBINE 64
+#endif
+
+//ranges shorter than this are checksummed by reading them; setting up
+//the controller's DMA checksum takes about as long as reading this many
+#ifndef ENC28J60_DMA_CHECKSUM_MIN
+#define ENC28J60_DMA_CHECKSUM_MIN 32
+#endif
+
 class ENC28J60Buffer: public Buffer {
   
   ENC28J60Driver* driver;
@@ -14,8 +34,27 @@ class ENC28J60Buffer: public Buffer {
   uint16_t bufferEnd;
   uint16_t payloadPointer;
   uint16_t len;
+  uint16_t dataLength;   //bytes from the payload pointer that hold data
   bool wrap;
 
+  //the read-ahead window; cacheLength bytes starting at cacheOffset
+  uint8_t* cache;
+  uint8_t cacheCapacity;
+  uint8_t cacheLength;
+  uint16_t cacheOffset;
+  uint32_t cacheHits;
+  uint32_t cacheMisses;
+
+  //small writes waiting to go to the controller; stageLength bytes
+  //starting at stageOffset
+  uint8_t* stage;
+  uint8_t stageCapacity;
+  uint8_t stageLength;
+  uint16_t stageOffset;
+
+  bool deviceAddress(uint16_t offset, uint16_t* address);
+  bool fetch(uint16_t offset, uint8_t* data, uint16_t len);
+
  public:
   ENC28J60Buffer(ENC28J60Driver* driver,
 		 uint16_t startAddress,
@@ -28,7 +67,53 @@ class ENC28J60Buffer: public Buffer {
   bool write(uint16_t offset, const void* data, uint16_t len);
   bool read(uint16_t offset, void* data, uint16_t len);
 
-  void setPayloadPointer(uint16_t offset);
+  //move the buffer to another area of controller memory; anything
+  //staged is written out first
+  void relocate(uint16_t startAddress, uint16_t endAddress);
+
+  //moving the payload pointer empties the read-ahead window and
+  //flushes any staged writes.  dataLength, if not 0, is how many bytes
+  //from there hold anything (the frame just received); the read-ahead
+  //window is not filled past them
+  void setPayloadPointer(uint16_t offset, uint16_t dataLength = 0);
+
+  //Reads of up to bytes bytes are answered from a window of that many
+  //bytes kept in SRAM, which is refilled from the controller (in one
+  //SPI transfer) whenever a read falls outside of it.  Parsing the
+  //headers of a frame then costs one transfer rather than one per
+  //field.  Larger reads go straight to the controller.  0 turns the
+  //window off; if the memory cannot be allocated it stays off.
+  //
+  //The driver gives its receive buffer an ENC28J60_READAHEAD byte
+  //window.  The window is only as fresh as the last read, so it is
+  //best left off for buffers the controller writes to by itself
+  //other than the receive buffer
+  void setReadAhead(uint8_t bytes);
+  uint8_t getReadAhead();
+
+  //reads answered from the window, and reads that had to refill it;
+  //for sizing the window
+  uint32_t getReadAheadHits();
+  uint32_t getReadAheadMisses();
+  void resetReadAheadCounters();
+
+  //Writes of up to bytes bytes are gathered in SRAM while they touch or
+  //overlap each other, and reach the controller in one SPI transfer
+  //when a write lands elsewhere, a read reaches partly into the stage,
+  //or flush() is called.  Reads that lie wholly in the stage are
+  //answered from it.  A frame's headers then cost one transfer
+  //however many fields they are written in.  0 turns it off; if the
+  //memory cannot be allocated it stays off.
+  //
+  //The driver gives its send buffer an ENC28J60_WRITECOMBINE byte
+  //stage and flushes it before every transmission.  Anyone else who
+  //hands the controller memory behind the buffer's back must flush
+  //first
+  void setWriteCombining(uint8_t bytes);
+  uint8_t getWriteCombining();
+
+  //write out anything staged.  False if the write fails
+  bool flush();
 
   bool copyTo(Buffer* dest,uint16_t dest_start=0, 
 	      uint16_t src_start = 0, uint16_t len = 0);
@@ -38,6 +123,12 @@ class ENC28J60Buffer: public Buffer {
 		uint16_t src_start = 0, 
 		uint16_t len = 0);
   
+  //summed by the controller's DMA engine, so the bytes stay where
+  //they are
+  uint32_t partialChecksum(uint16_t offset, uint16_t len, uint32_t sum = 0);
+  bool copyToAndSum(Buffer* destination, uint16_t dest_start,
+		    uint16_t src_start, uint16_t len, uint32_t* sum);
+
   uint8_t getBufferType();
   const static uint8_t BufferType = 3;
 };
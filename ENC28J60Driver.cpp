@@ -21,30 +21,30 @@
  * 2013-11-01
  */
 
+#include <stdio.h>
+#include <string.h>
 #include "ENC28J60Driver.h"
 #include "ENC28J60Registers.h"
 
-#if ARDUINO >= 100
+#if !defined(ARDUINO)
+#include <ENC28J60SimArduino.h> // the host, against ENC28J60Sim
+#elif ARDUINO >= 100
 #include <Arduino.h> // Arduino 1.0
 #else
 #include <Wprogram.h> // Arduino 0022
 #endif
 
-// The RXSTART_INIT must be zero. See Rev. B4 Silicon Errata point 5.
-// Buffer boundaries applied to internal 8K ram
-// the entire available packet buffer space is allocated
+// The controller's memory is laid out as enc28j60Layout describes
+// (see ENC28J60Driver.h); the receive ring must start at zero.  See
+// Rev. B4 Silicon Errata point 5.  The stash is unused space by the
+// driver but may be used by the application via the StashBuffer
+#define MEMORY_END          0x1FFF  // the last byte of the 8K ram
 
-#define RXSTART_INIT        0x0000  // start of RX buffer
-                                    // room for 2 packets at 1500 MTU (3071)
-#define RXSTOP_INIT         0x0BFF  // end of RX buffer
-#define TXSTART_INIT        0x0C00  // start of TX buffer, room for 1 packet
-#define TXSTOP_INIT         0x11FF  // end of TX buffer 4607 - 3072 = 1535
-
-//scratch area is 3584 bytes
-//this is unused space by the driver but may be used
-//by the application via the StashBuffer
-#define STASH_START_INIT  0x1200  // start of scratch area
-#define STASH_STOP_INIT   0x1FFF  // end of scratch area
+#if ENC28J60_TX_SLOTS < 1 || ENC28J60_TX_SLOTS > ENC28J60_MAX_TX_SLOTS || \
+    ENC28J60_RX_SIZE < ENC28J60_MIN_RX_SIZE || (ENC28J60_RX_SIZE & 1) || \
+    ENC28J60_RX_SIZE + ENC28J60_TX_SLOTS*ENC28J60_TXSLOT_SIZE > MEMORY_END + 1
+#error ENC28J60_RX_SIZE and ENC28J60_TX_SLOTS do not fit in the controller
+#endif
 
 // max frame length which the conroller will accept:
 // (note: maximum ethernet frame length would be 1518)
@@ -53,22 +53,48 @@
 /* ======================================================================= */
 /*                            I N I T I A L I Z E                          */
 /* ======================================================================= */
-ENC28J60Driver::ENC28J60Driver(uint8_t* macaddr, uint8_t csPin): 
+ENC28J60Driver::ENC28J60Driver(uint8_t* macaddr, uint8_t csPin,
+			       const enc28j60Layout* layout):
   EthernetDriver(macaddr){
 
-  this->sendBuffer = new ENC28J60Buffer(this,TXSTART_INIT+1,
-					TXSTOP_INIT,
+  if (layout != NULL && checkLayout(layout))
+    this->layout = *layout;
+  else {
+#ifdef DEBUG
+    if (layout != NULL)
+      fprintf(stderr,"Bad ENC28J60 memory layout, using the default\n");
+#endif
+    this->layout.receiveStart = 0;
+    this->layout.receiveEnd = ENC28J60_RX_SIZE - 1;
+    this->layout.transmitSlots = ENC28J60_TX_SLOTS;
+  }
+  this->transmitStart = this->layout.receiveEnd + 1;
+  this->transmitEnd = this->transmitStart +
+    this->layout.transmitSlots*ENC28J60_TXSLOT_SIZE - 1;
+
+  this->copying = false;
+  for(uint8_t i=0; i<ENC28J60_MAX_TX_SLOTS; i++)
+    this->slotLength[i] = 0;
+  this->sendSlot = 0;
+  this->transmitSlot = 0;
+  this->transmitting = false;
+  this->spiAccount = ENC28J60_SPI_OTHER;
+  resetSPICounters();
+
+  this->sendBuffer = new ENC28J60Buffer(this,slotStart(0)+1,
+					slotStart(0)+ENC28J60_TXSLOT_SIZE-1,
 					MAX_FRAMELEN,
 					0,false);
-  this->recvBuffer = new ENC28J60Buffer(this,RXSTART_INIT,
-					RXSTOP_INIT,
+  this->sendBuffer->setWriteCombining(ENC28J60_WRITECOMBINE);
+  this->recvBuffer = new ENC28J60Buffer(this,this->layout.receiveStart,
+					this->layout.receiveEnd,
 					MAX_FRAMELEN,
 					0,true);
-  this->stashBuffer = new ENC28J60Buffer(this,STASH_START_INIT,
-					 STASH_STOP_INIT,
-					 STASH_STOP_INIT - STASH_START_INIT +1,
+  this->recvBuffer->setReadAhead(ENC28J60_READAHEAD);
+  this->stashBuffer = new ENC28J60Buffer(this,transmitEnd+1,
+					 MEMORY_END,
+					 MEMORY_END - transmitEnd,
 					 0,false);
-					 
 
   if (bitRead(SPCR, SPE) == 0)
     initSPI();
@@ -80,20 +106,26 @@ ENC28J60Driver::ENC28J60Driver(uint8_t* macaddr, uint8_t csPin):
   writeOp(ENC28J60_SOFT_RESET, 0, ENC28J60_SOFT_RESET);
   delay(20); // errata B7/2
 
+  //the reset leaves us in bank 0, with the pointers at their defaults
+  Enc28j60Bank = 0;
+  for(uint8_t i=0; i<sizeof(pointers)/sizeof(pointers[0]); i++)
+    pointers[i] = 0xFFFF;
+
   while (!readOp(ENC28J60_READ_CTRL_REG, ESTAT) & ESTAT_CLKRDY)
     ;
   
-  gNextPacketPtr = RXSTART_INIT;
-  writeReg(ERXST, RXSTART_INIT);
-  writeReg(ERXRDPT, RXSTART_INIT);
-  writeReg(ERXND, RXSTOP_INIT);
-  writeReg(ETXST, TXSTART_INIT);
-  writeReg(ETXND, TXSTOP_INIT);
+  gNextPacketPtr = this->layout.receiveStart;
+  writeReg(ERXST, this->layout.receiveStart);
+  writeReg(ERXRDPT, this->layout.receiveStart);
+  writeReg(ERXND, this->layout.receiveEnd);
+  writeReg(ETXST, transmitStart);
+  writeReg(ETXND, transmitEnd);
   
-  writeRegByte(ERXFCON, ERXFCON_UCEN|ERXFCON_CRCEN|ERXFCON_PMEN|ERXFCON_BCEN);
+  receiveFilter filter;
+  memset(&filter, 0, sizeof(filter));
+  filter.accept = RECEIVE_UNICAST|RECEIVE_BROADCAST;
+  setReceiveFilter(&filter);
 
-  writeReg(EPMM0, 0x303f);
-  writeReg(EPMCS, 0xf7f9);
   writeRegByte(MACON1, MACON1_MARXEN|MACON1_TXPAUS|MACON1_RXPAUS);
   writeRegByte(MACON2, 0x00);
   writeOp(ENC28J60_BIT_FIELD_SET, MACON3,
@@ -119,13 +151,47 @@ ENC28J60Driver::ENC28J60Driver(uint8_t* macaddr, uint8_t csPin):
   // to see what they do when they release B8. At the moment
   // there is no B8 out yet
   if (this->revision > 5) this->revision++;
+
+  //the control byte in front of each frame is always 0x00 (send as
+  //MACON3 says).  Nothing else writes there, so it is written just once
+  uint8_t control = 0x00;
+  for(uint8_t i=0; i<this->layout.transmitSlots; i++)
+    write(slotStart(i), &control, 1);
+}
+
+
+bool ENC28J60Driver::checkLayout(const enc28j60Layout* layout){
+  //errata B4/5
+  if (layout->receiveStart != 0) return false;
+
+  //an even sized ring that takes a full frame
+  if ((layout->receiveEnd & 1) == 0) return false;
+  if ((uint32_t)layout->receiveEnd + 1 < ENC28J60_MIN_RX_SIZE) return false;
+
+  if (layout->transmitSlots < 1 ||
+      layout->transmitSlots > ENC28J60_MAX_TX_SLOTS) return false;
+
+  //the stash may be left empty
+  return (uint32_t)layout->receiveEnd + 1 +
+    (uint32_t)layout->transmitSlots*ENC28J60_TXSLOT_SIZE <= MEMORY_END + 1;
 }
 
+const enc28j60Layout* ENC28J60Driver::getLayout(){
+  return &layout;
+}
 
 /* ======================================================================= */
 /*                        P R I V A T E    H E L P E R S                   */
 /* ======================================================================= */
 
+uint16_t ENC28J60Driver::slotStart(uint8_t slot){
+  return transmitStart + slot*ENC28J60_TXSLOT_SIZE;
+}
+
+bool ENC28J60Driver::inReceiveBuffer(uint16_t address){
+  return address >= layout.receiveStart && address <= layout.receiveEnd;
+}
+
 void ENC28J60Driver::initSPI () {
     pinMode(SS, OUTPUT);
     digitalWrite(SS, HIGH);
@@ -165,6 +231,7 @@ byte ENC28J60Driver::readOp (uint8_t op, uint8_t address) {
         xferSPI(0x00);
     uint8_t result = SPDR;
     disableChip();
+    countSPI(address & 0x80 ? 3 : 2);
     return result;
 }
 
@@ -174,14 +241,22 @@ void ENC28J60Driver::writeOp (uint8_t op, uint8_t address, uint8_t data) {
     xferSPI(op | (address & ADDR_MASK));
     xferSPI(data);
     disableChip();
+    countSPI(2);
 }
 
+//the common registers are in every bank, and a bank whose select bits
+//only need setting (or only clearing) takes one bit field operation
 void ENC28J60Driver::SetBank (uint8_t address) {
-    if ((address & BANK_MASK) != Enc28j60Bank) {
-        writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_BSEL1|ECON1_BSEL0);
-        Enc28j60Bank = address & BANK_MASK;
-        writeOp(ENC28J60_BIT_FIELD_SET, ECON1, Enc28j60Bank>>5);
-    }
+    uint8_t bank = address & BANK_MASK;
+    if ((address & ADDR_MASK) >= EIE || bank == Enc28j60Bank)
+        return;
+    uint8_t clear = (Enc28j60Bank & ~bank) >> 5;
+    uint8_t set = (bank & ~Enc28j60Bank) >> 5;
+    if (clear)
+        writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, clear);
+    if (set)
+        writeOp(ENC28J60_BIT_FIELD_SET, ECON1, set);
+    Enc28j60Bank = bank;
 }
 
 uint8_t ENC28J60Driver::readRegByte (uint8_t address) {
@@ -198,7 +273,21 @@ void ENC28J60Driver::writeRegByte (uint8_t address, uint8_t data) {
     writeOp(ENC28J60_WRITE_CTRL_REG, address, data);
 }
 
+//a pointer we know the value of only has its changed bytes written,
+//except ERXRDPT, which takes effect when its high byte is written
 void ENC28J60Driver::writeReg(uint8_t address, uint16_t data) {
+    if ((address & (BANK_MASK|SPRD_MASK)) == 0 && address < EDMACS) {
+        uint16_t* known = &pointers[address >> 1];
+        if (*known == data)
+            return;
+        bool whole = *known == 0xFFFF || address == ERXRDPT;
+        if (whole || (*known & 0xFF) != (data & 0xFF))
+            writeRegByte(address, data);
+        if (whole || (*known >> 8) != (data >> 8))
+            writeRegByte(address + 1, data >> 8);
+        *known = data;
+        return;
+    }
     writeRegByte(address, data);
     writeRegByte(address + 1, data >> 8);
 }
@@ -227,7 +316,17 @@ Buffer* ENC28J60Driver::getSendBuffer(){ return sendBuffer;  }
 Buffer* ENC28J60Driver::getReceiveBuffer(){ return recvBuffer;  }
 Buffer* ENC28J60Driver::getStashBuffer(){ return stashBuffer;  }
 
+//ERDPT moves on as we read, wrapping at the end of the receive buffer
 void ENC28J60Driver::readBuf(uint16_t len, uint8_t* data) {
+    countSPI(len + 1);
+    uint16_t* known = &pointers[ERDPT >> 1];
+    if (*known != 0xFFFF) {
+        uint16_t end = *known + len;
+        if (inReceiveBuffer(*known) && end > layout.receiveEnd)
+            end -= layout.receiveEnd - layout.receiveStart + 1;
+        *known = end & 0x1FFF;
+    }
+
     enableChip();
     xferSPI(ENC28J60_READ_BUF_MEM);
     while (len--) {
@@ -237,7 +336,13 @@ void ENC28J60Driver::readBuf(uint16_t len, uint8_t* data) {
     disableChip();
 }
 
+//and EWRPT as we write
 void ENC28J60Driver::writeBuf(uint16_t len, const uint8_t* data) {
+    countSPI(len + 1);
+    uint16_t* known = &pointers[EWRPT >> 1];
+    if (*known != 0xFFFF)
+        *known = (*known + len) & 0x1FFF;
+
     enableChip();
     xferSPI(ENC28J60_WRITE_BUF_MEM); //send spi command for write mem
     while (len--)
@@ -247,41 +352,61 @@ void ENC28J60Driver::writeBuf(uint16_t len, const uint8_t* data) {
 
 
 bool ENC28J60Driver::write(uint16_t offset, uint8_t* data, uint16_t len){
-  
+
+  //writing a frame is part of sending it
+  uint8_t account = spiAccount;
+  if (offset >= transmitStart && offset <= transmitEnd)
+    account = ENC28J60_SPI_SEND;
+  account = charge(account);
+
+  settle(offset,len,true);
   writeReg(EWRPT, offset);     //where will we start to write
   writeBuf(len,data);
+
+  charge(account);
   return true;
 }
 
 bool ENC28J60Driver::read(uint16_t offset, uint8_t* data, uint16_t len){
 
+  //and reading one part of receiving it
+  uint8_t account = spiAccount;
+  if (inReceiveBuffer(offset))
+    account = ENC28J60_SPI_RECEIVE;
+  account = charge(account);
+
+  settle(offset,len,false);
   writeReg(ERDPT, offset);     //where will we start to read
   readBuf(len,data);
+
+  charge(account);
   return true;
 }
 
-bool ENC28J60Driver::copy(uint16_t src_addr_start, 
-			  uint16_t dest_addr, uint16_t len){
+bool ENC28J60Driver::startCopy(uint16_t src_addr_start, 
+			       uint16_t dest_addr, uint16_t len){
 
   //sanity check the dest_addr and src_addr_start
   if (dest_addr > 0x1FFF) return false;
   if (src_addr_start > 0x1FFF) return false;
+  if (len == 0) return true;
 
   //we should never write to the receive buffer
-  if (dest_addr >= RXSTART_INIT && dest_addr <= RXSTOP_INIT)
+  if (inReceiveBuffer(dest_addr))
     return false;
 
-  //set the address at which we stop copying
-  uint16_t src_addr_end = src_addr_start + len;
+  //set the address of the last byte to copy
+  uint16_t src_addr_end = src_addr_start + len - 1;
   
   //if we are starting in the recv buffer, then the internal pointer
   //will loop around to the beginning of the receive buffer, so 
   //determining the end pointer is a special case
-  if (src_addr_start >= RXSTART_INIT && src_addr_start <= RXSTOP_INIT){
-    if (src_addr_end > RXSTOP_INIT)
-      src_addr_end = src_addr_end - RXSTOP_INIT + RXSTART_INIT - 1;
-    //if the src_addr_end is still beyond RXSTOP_INIT return false;
-    if (src_addr_end > RXSTOP_INIT) return false;
+  if (inReceiveBuffer(src_addr_start)){
+    if (src_addr_end > layout.receiveEnd)
+      src_addr_end = src_addr_end - layout.receiveEnd + 
+	layout.receiveStart - 1;
+    //if the src_addr_end is still beyond the ring return false;
+    if (src_addr_end > layout.receiveEnd) return false;
   }
   
   
@@ -292,12 +417,12 @@ bool ENC28J60Driver::copy(uint16_t src_addr_start,
   //which is the end of our memory buffer on the controller
   if (dest_addr+len > 0x1FFF) return false;
 
-  //make sure a DMA is not in progress
-  if(readOp(ENC28J60_READ_CTRL_REG, ECON1) & ECON1_DMAST)
-    return false;
+  //one copy at a time, and never over a frame waiting to be sent
+  waitForCopy();
+  settle(dest_addr,len,true);
 
-  //clear the DMAST bit and the CSUMEN bit
-  writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_DMAST | ECON1_CSUMEN);
+  //DMAST is clear now the last copy is done, and checksum clears
+  //CSUMEN when it is finished with it
 
   //set our read start and end pointers
   writeReg(EDMAST, src_addr_start);
@@ -310,11 +435,155 @@ bool ENC28J60Driver::copy(uint16_t src_addr_start,
   //setting the DMAST bit on the ECON1 register starts the DMA copy
   writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_DMAST);
 
-  //wait for copy to finish
-  //the controller will clear this bit when done
+  copying = true;
+  copySource = src_addr_start;
+  copyDestination = dest_addr;
+  copyLength = len;
+  return true;
+}
+
+bool ENC28J60Driver::copyInProgress(){
+  if (!copying) return false;
+
+  //the controller clears DMAST when the copy is done
+  if (readOp(ENC28J60_READ_CTRL_REG, ECON1) & ECON1_DMAST)
+    return true;
+  copying = false;
+
+  //send the frame that was waiting on the copy
+  pumpTransmit();
+  return false;
+}
+
+void ENC28J60Driver::waitForCopy(){
+  while (copyInProgress())
+    ;
+}
+
+bool ENC28J60Driver::copy(uint16_t src_addr_start, 
+			  uint16_t dest_addr, uint16_t len){
+  if (!startCopy(src_addr_start,dest_addr,len)) return false;
+  waitForCopy();
+  return true;
+}
+
+//wait for the copy in progress if len bytes at address are being copied
+//to, or (when we mean to write them) copied from.  Writes also wait for
+//any frame queued in the memory they write to
+void ENC28J60Driver::settle(uint16_t address, uint16_t len, bool writing){
+
+  //a frame waiting to go, or going, must not be written over
+  if (writing && address <= transmitEnd && address + len > transmitStart){
+    for(uint8_t i=0; i<layout.transmitSlots; i++)
+      if (address < slotStart(i) + ENC28J60_TXSLOT_SIZE &&
+	  address + len > slotStart(i))
+	waitForSlot(i);
+  }
+
+  if (!copying) return;
+
+  if (address < copyDestination + copyLength && 
+      address + len > copyDestination){
+    waitForCopy();
+    return;
+  }
+
+  if (!writing) return;
+
+  //a copy out of the receive buffer may wrap; any of it will do
+  if (inReceiveBuffer(copySource)){
+    if (address <= layout.receiveEnd) waitForCopy();
+  }
+  else if (address < copySource + copyLength && 
+	   address + len > copySource)
+    waitForCopy();
+}
+
+//the DMA engine sums the range instead of copying it when CSUMEN is set
+bool ENC28J60Driver::checksum(uint16_t address, uint16_t len, uint16_t* out){
+
+  if (len == 0 || address > 0x1FFF) return false;
+
+  //the last byte to sum; like a copy, a range that starts in the
+  //receive buffer carries on from its start when it runs off the end
+  uint16_t end = address + len - 1;
+  if (inReceiveBuffer(address)){
+    if (end > layout.receiveEnd)
+      end = end - layout.receiveEnd + layout.receiveStart - 1;
+    if (end > layout.receiveEnd) return false;
+  }
+  if (end > 0x1FFF) return false;
+
+  //the engine may be busy with a copy
+  waitForCopy();
+
+  writeReg(EDMAST, address);
+  writeReg(EDMAND, end);
+
+  writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_CSUMEN | ECON1_DMAST);
   while(readOp(ENC28J60_READ_CTRL_REG, ECON1) & ECON1_DMAST)
     ;
+  writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_CSUMEN);
 
+  //EDMACSH holds the first byte of the checksum as it goes on the
+  //wire, so the register pair reads back in host order
+  *out = readReg(EDMACS);
+  return true;
+}
+
+//section 8.2
+bool ENC28J60Driver::setReceiveFilter(const receiveFilter* filter){
+
+  const receivePattern* pattern = &filter->pattern;
+  if ((filter->accept & RECEIVE_PATTERN) && pattern->length == 0)
+    return false;
+
+  uint8_t filters = ERXFCON_CRCEN;
+  if (filter->accept & RECEIVE_UNICAST) filters |= ERXFCON_UCEN;
+  if (filter->accept & RECEIVE_BROADCAST) filters |= ERXFCON_BCEN;
+  if (filter->accept & RECEIVE_MULTICAST) filters |= ERXFCON_MCEN;
+  if (filter->accept & RECEIVE_MAGIC) filters |= ERXFCON_MPEN;
+
+  if (filter->accept & RECEIVE_HASH){
+    for(uint8_t i=0; i<8; i++)
+      writeRegByte(EHT0 + i, filter->hashTable[i]);
+    filters |= ERXFCON_HTEN;
+  }
+
+  if (filter->accept & RECEIVE_PATTERN){
+    //the window starts on an even offset
+    uint8_t start = 0xFF;
+    for(uint8_t i=0; i<pattern->length; i++)
+      if (pattern->offset[i] < start) start = pattern->offset[i];
+    start &= ~1;
+
+    //the controller picks out the bytes set in the mask and checksums
+    //them as though they sat side by side, and compares that to EPMCS
+    uint8_t mask[8];
+    memset(mask, 0, sizeof(mask));
+    uint32_t sum = 0;
+    bool high = true;
+    for(uint8_t b=0; b<64; b++){
+      uint8_t i;
+      for(i=0; i<pattern->length; i++)
+	if (pattern->offset[i] == start + b) break;
+      if (i == pattern->length) continue;
+
+      mask[b >> 3] |= 1 << (b & 7);
+      sum += high ? (uint16_t)pattern->value[i] << 8 : pattern->value[i];
+      high = !high;
+    }
+    while (sum >> 16)
+      sum = (sum & 0xFFFF) + (sum >> 16);
+
+    writeReg(EPMO, start);
+    for(uint8_t i=0; i<8; i++)
+      writeRegByte(EPMM0 + i, mask[i]);
+    writeReg(EPMCS, ~sum);
+    filters |= ERXFCON_PMEN;
+  }
+
+  writeRegByte(ERXFCON, filters);
   return true;
 }
 
@@ -322,32 +591,114 @@ bool ENC28J60Driver::copy(uint16_t src_addr_start,
 /*                    S E N D      A N D      R E C E I V E                */
 /* ======================================================================= */
 
+//the frame is queued in its slot and the send buffer moves on to the
+//next one, so the next frame can be built while this one goes out
 void ENC28J60Driver::sendFrame(uint16_t len) {
 
-  //while we're current transmitting, simply wait
-  while (readOp(ENC28J60_READ_CTRL_REG, ECON1) & ECON1_TXRTS){
-    //but if there was a tx error
-    if (readRegByte(EIR) & EIR_TXERIF) { 
-      //reset all transmission logic
-      writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRST);
-      writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_TXRST);
+  uint8_t account = charge(ENC28J60_SPI_SEND);
+
+  //the last of the frame may still be waiting in SRAM
+  sendBuffer->flush();
+
+  if (len > 0){
+    //the slot is normally free by now, as writing the frame waited for
+    //it, but the frame may not have been written at all
+    waitForSlot(sendSlot);
+    slotLength[sendSlot] = len;
+    spiCounters[ENC28J60_SPI_SEND].frames++;
+
+    sendSlot = (sendSlot + 1) % layout.transmitSlots;
+    sendBuffer->relocate(slotStart(sendSlot)+1,
+			 slotStart(sendSlot)+ENC28J60_TXSLOT_SIZE-1);
+
+    pumpTransmit();
+  }
+
+  charge(account);
+}
+
+//start the oldest queued frame if the controller is free to send it
+void ENC28J60Driver::pumpTransmit() {
+  uint8_t account = charge(ENC28J60_SPI_SEND);
+  transmitNext();
+  charge(account);
+}
+
+void ENC28J60Driver::transmitNext() {
+
+  if (transmitting){
+    //still going
+    if (readOp(ENC28J60_READ_CTRL_REG, ECON1) & ECON1_TXRTS){
+      //but if there was a tx error
+      if (readRegByte(EIR) & EIR_TXERIF) { 
+	//reset all transmission logic
+	writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRST);
+	writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_TXRST);
+      }
+      return;
     }
+    transmitting = false;
+    slotLength[transmitSlot] = 0;
+    transmitSlot = (transmitSlot + 1) % layout.transmitSlots;
   }
 
-  //set the packet end
-  writeReg(ETXND, TXSTART_INIT+len);
+  uint16_t len = slotLength[transmitSlot];
+  if (len == 0) return; //nothing queued
+
+  //part of the frame may still be being copied in; copyInProgress
+  //calls us again when it lands, which may already have happened
+  uint16_t start = slotStart(transmitSlot);
+  if (copying && copyDestination < start + ENC28J60_TXSLOT_SIZE &&
+      copyDestination + copyLength > start){
+    copyInProgress();
+    return;
+  }
 
-  //write the control byte (which is always 0x00 in our case)
-  writeReg(EWRPT, TXSTART_INIT); 
-  writeOp(ENC28J60_WRITE_BUF_MEM, 0, 0x00);
+  //set the packet start (the control byte, written when we started)
+  //and end
+  writeReg(ETXST, start);
+  writeReg(ETXND, start+len);
 
   //start a transmission
   writeOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRTS);
+  transmitting = true;
+}
+
+//wait until the frame in slot has been sent
+void ENC28J60Driver::waitForSlot(uint8_t slot) {
+  while (slotLength[slot] != 0){
+    copyInProgress();
+    pumpTransmit();
+  }
+}
+
+uint8_t ENC28J60Driver::getFreeTransmitSlots() {
+  uint8_t account = charge(ENC28J60_SPI_SEND);
+  copyInProgress();
+  pumpTransmit();
+  charge(account);
+
+  uint8_t free = 0;
+  for(uint8_t i=0; i<layout.transmitSlots; i++)
+    if (slotLength[i] == 0) free++;
+  return free;
 }
 
 
 uint16_t ENC28J60Driver::receiveFrame() {
     uint16_t len = 0;
+    uint8_t account = charge(ENC28J60_SPI_RECEIVE);
+
+    //finish off a copy that has completed, sending the frame it was
+    //holding up.  A copy out of the receive buffer must be done before
+    //we hand the last frame's memory back to the controller
+    if (copyInProgress() && 
+	inReceiveBuffer(copySource))
+      waitForCopy();
+
+    //and start the next queued frame if the last has gone
+    pumpTransmit();
+
     //if we have more than zero packets in the buffer
     if (readRegByte(EPKTCNT) > 0) {
       writeReg(ERDPT, gNextPacketPtr);
@@ -362,14 +713,16 @@ uint16_t ENC28J60Driver::receiveFrame() {
 
       //ERDPT will have automatically advanced since we've 
       //read the header, so we can set our offset value
-      //to the new value of ERDPT
-      uint16_t offset = readReg(ERDPT);
-      recvBuffer->setPayloadPointer(offset);
+      //to the new value of ERDPT, which readBuf worked out
+      uint16_t offset = pointers[ERDPT >> 1];
       
       gNextPacketPtr  = header.nextPacket;
       len = header.byteCount - 4; //remove the CRC count
       if (len > getReceiveBuffer()->size())
 	len = getReceiveBuffer()->size();
+
+      //reads of the frame go no further than its end
+      recvBuffer->setPayloadPointer(offset, len);
       if ((header.status & 0x80) == 0)
 	len = 0;
 
@@ -380,11 +733,51 @@ uint16_t ENC28J60Driver::receiveFrame() {
 
       writeOp(ENC28J60_BIT_FIELD_SET, ECON2, ECON2_PKTDEC);
 
+      spiCounters[ENC28J60_SPI_RECEIVE].frames++;
     }
 
+    charge(account);
     return len;
 }
 
+uint8_t ENC28J60Driver::getPendingFrames() {
+  //callers may poll this rather than receiveFrame while waiting for an
+  //answer, so it too must send a frame that was held up by a copy
+  copyInProgress();
+  pumpTransmit();
+
+  uint8_t account = charge(ENC28J60_SPI_RECEIVE);
+  uint8_t pending = readRegByte(EPKTCNT);
+  charge(account);
+  return pending;
+}
+
+/* ======================================================================= */
+/*                    S P I     A C C O U N T I N G                        */
+/* ======================================================================= */
+
+//charge the SPI traffic that follows to account; returns the account
+//to go back to
+uint8_t ENC28J60Driver::charge(uint8_t account) {
+  uint8_t previous = spiAccount;
+  spiAccount = account;
+  return previous;
+}
+
+void ENC28J60Driver::countSPI(uint16_t bytes) {
+  spiCounters[spiAccount].commands++;
+  spiCounters[spiAccount].bytes += bytes;
+}
+
+enc28j60SPICounters* ENC28J60Driver::getSPICounters(uint8_t account) {
+  if (account > ENC28J60_SPI_OTHER) return NULL;
+  return &spiCounters[account];
+}
+
+void ENC28J60Driver::resetSPICounters() {
+  memset(spiCounters, 0, sizeof(spiCounters));
+}
+
 /* ======================================================================= */
 /*                      P O W E R     M A N A G E M E N T                  */
 /* ======================================================================= */
@@ -399,6 +792,8 @@ bool ENC28J60Driver::isLinkUp() {
  *       putting-enc28j60-ethernet-controler-in-sleep-mode/
  */
 void ENC28J60Driver::powerDown() {
+  for(uint8_t i=0; i<layout.transmitSlots; i++)
+    waitForSlot(i);
   writeOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_RXEN);
   while(readRegByte(ESTAT) & ESTAT_RXBUSY);
   while(readRegByte(ECON1) & ECON1_TXRTS);
@@ -7,6 +7,48 @@
 class ENC28J60Buffer;
 #include "ENC28J60Buffer.h"
 
+//The controller's 8 KB is divided into the receive ring, which must
+//start at address 0 (rev. B4 silicon errata, item 5), the transmit
+//slots straight after it, and the stash, which gets whatever is left.
+//A device that mostly receives may want a bigger ring, one with many
+//TCP sockets a bigger stash
+typedef struct enc28j60Layout {
+  uint16_t receiveStart;   //must be 0
+  uint16_t receiveEnd;     //the last byte of the ring; odd, as frames
+                           //start on even addresses
+  uint8_t transmitSlots;   //frames that can be queued for transmission
+} enc28j60Layout;
+
+//each transmit slot holds a frame, its control byte and the transmit
+//status vector
+#define ENC28J60_TXSLOT_SIZE  0x0600
+#define ENC28J60_MAX_TX_SLOTS 3
+
+//the smallest ring that holds two full frames with their headers.  The
+//frame being read is kept until the next one is asked for, so a ring
+//with room for only one would drop every other full sized frame
+#define ENC28J60_MIN_RX_SIZE  0x0C00
+
+//the layout used when none is given: a 3 KB ring, two transmit slots
+//and a 2 KB stash
+#ifndef ENC28J60_RX_SIZE
+#define ENC28J60_RX_SIZE  0x0C00
+#endif
+#ifndef ENC28J60_TX_SLOTS
+#define ENC28J60_TX_SLOTS 2
+#endif
+
+//the accounts SPI traffic is charged to (see getSPICounters)
+#define ENC28J60_SPI_SEND     0  //building, queueing and sending frames
+#define ENC28J60_SPI_RECEIVE  1  //polling for and reading frames
+#define ENC28J60_SPI_OTHER    2  //the stash, DMA, the PHY and set up
+
+typedef struct enc28j60SPICounters {
+  uint32_t frames;     //frames sent or received
+  uint32_t commands;   //SPI transactions
+  uint32_t bytes;      //bytes clocked, command bytes included
+} enc28j60SPICounters;
+
 class ENC28J60Driver: public EthernetDriver {
 
   uint8_t Enc28j60Bank;
@@ -17,6 +59,33 @@ class ENC28J60Driver: public EthernetDriver {
   ENC28J60Buffer *recvBuffer;
   ENC28J60Buffer *stashBuffer;
 
+  //the DMA copy in progress
+  bool copying;
+  uint16_t copySource;
+  uint16_t copyDestination;
+  uint16_t copyLength;
+
+  enc28j60Layout layout;
+  uint16_t transmitStart;
+  uint16_t transmitEnd;
+
+  //the length of the frame queued in each transmit slot (0 when the
+  //slot is free), the slot the send buffer is in, and the oldest
+  //queued slot, which is on the wire when transmitting is set
+  uint16_t slotLength[ENC28J60_MAX_TX_SLOTS];
+  uint8_t sendSlot;
+  uint8_t transmitSlot;
+  bool transmitting;
+
+  //what the bank 0 pointer registers (ERDPT to EDMADST) hold, a word
+  //each and 0xFFFF when unknown, so bytes that would not change are
+  //not written.  ERDPT and EWRPT are moved along as the controller
+  //moves them
+  uint16_t pointers[11];
+
+  enc28j60SPICounters spiCounters[3];
+  uint8_t spiAccount;
+
   //helpers
   void initSPI();
   void enableChip();
@@ -33,26 +102,86 @@ class ENC28J60Driver: public EthernetDriver {
   void writePhy (uint8_t address, uint16_t data);
   void readBuf(uint16_t len, uint8_t* data);
   void writeBuf(uint16_t len, const uint8_t* data);
+  void settle(uint16_t address, uint16_t len, bool writing);
+  uint8_t charge(uint8_t account);
+  void countSPI(uint16_t bytes);
+  void pumpTransmit();
+  void transmitNext();
+  uint16_t slotStart(uint8_t slot);
+  bool inReceiveBuffer(uint16_t address);
+  void waitForSlot(uint8_t slot);
 
 
 public:
 
-  ENC28J60Driver(uint8_t* mac,uint8_t csPin = 10);
+  //the default layout is used if layout is NULL or fails checkLayout
+  ENC28J60Driver(uint8_t* mac,uint8_t csPin = 10,
+		 const enc28j60Layout* layout = NULL);
+
+  //false if the layout breaks any of the rules above, or leaves the
+  //transmit slots hanging off the end of memory
+  static bool checkLayout(const enc28j60Layout* layout);
+  const enc28j60Layout* getLayout();
   
   Buffer* getSendBuffer();
   Buffer* getReceiveBuffer();
   Buffer* getStashBuffer();
 
+  //Frames are queued in transmit slots and sent one after another as
+  //the wire frees up, so sendFrame does not wait for the last frame to
+  //go.  The send buffer moves to the next slot each time; writing to it
+  //waits only if that slot's frame hasn't gone yet.  Its old contents
+  //are not carried over, so a frame must be built afresh to be sent
+  //again
   void sendFrame (uint16_t len);
+
+  //the slots with no frame in them; 0 means building the next frame
+  //will wait for one to be sent
+  uint8_t getFreeTransmitSlots();
   uint16_t receiveFrame();
 
+  //the controller's count of frames in the receive buffer (EPKTCNT)
+  uint8_t getPendingFrames();
+
   bool isLinkUp ();
   void powerDown();
   void powerUp();
 
   bool write(uint16_t offset, uint8_t* data, uint16_t length);
   bool read(uint16_t offset, uint8_t* data, uint16_t length);
+
+  //Copies between areas of controller memory are done by its DMA
+  //engine, which runs on its own once started.  startCopy returns as
+  //soon as the copy is under way (after waiting for any earlier one);
+  //copyInProgress polls it and waitForCopy waits for it.  copy does
+  //both and returns when the copy is done.
+  //
+  //Until the copy is done, reading or writing the memory being copied
+  //to, or writing the memory being copied from, waits for it, and a
+  //frame sent from the transmit buffer while it is being copied to is
+  //held back and sent when the copy finishes.  Everything else (the
+  //receive buffer in particular) carries on, so a stash copy overlaps
+  //with receive processing.  receiveFrame notices when a copy is done
+  bool startCopy(uint16_t src_addr, uint16_t dest_addr, uint16_t len);
+  bool copyInProgress();
+  void waitForCopy();
   bool copy(uint16_t src_addr, uint16_t dest_addr, uint16_t len);
+  bool checksum(uint16_t address, uint16_t len, uint16_t* out);
+
+  //All of the filters are done by the controller.  The pattern is
+  //matched over a 64 byte window starting at (or just before) its
+  //lowest offset, and any of its bytes past the window are left out.
+  //Frames with a bad CRC are always dropped.  Until this is called,
+  //unicasts and broadcasts are received
+  bool setReceiveFilter(const receiveFilter* filter);
+
+  //SPI transactions and bytes so far, charged to ENC28J60_SPI_SEND,
+  //ENC28J60_SPI_RECEIVE or ENC28J60_SPI_OTHER, with the frames sent
+  //or received, so the cost of a frame is commands / frames.  Writes
+  //to the send buffer count as sending and reads of the receive
+  //buffer as receiving
+  enc28j60SPICounters* getSPICounters(uint8_t account);
+  void resetSPICounters();
 };
 
 #endif
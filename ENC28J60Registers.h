@@ -47,7 +47,7 @@
 #define EPMM6            (0x0E|0x20)
 #define EPMM7            (0x0F|0x20)
 #define EPMCS           (0x10|0x20)
-// #define EPMO            (0x14|0x20)
+#define EPMO            (0x14|0x20)
 #define EWOLIE           (0x16|0x20)
 #define EWOLIR           (0x17|0x20)
 #define ERXFCON          (0x18|0x20)
@@ -0,0 +1,579 @@
+/*
+ * This is a software model of the ENC28J60 for running ENC28J60Driver
+ * on the host.  See ENC28J60Sim.h for details.  Section and register
+ * numbers refer to the datasheet:
+ *    http://ww1.microchip.com/downloads/en/DeviceDoc/39662c.pdf
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "ENC28J60Sim.h"
+#include "ENC28J60SimArduino.h"
+#include "ENC28J60Registers.h"
+
+//the driver's view of the SPI port
+ENC28J60SimDataRegister SPDR;
+uint8_t SPCR = 0;
+uint8_t SPSR = bit(SPIF);
+
+//a register by its name in ENC28J60Registers.h, without the MAC/MII bit
+#define REG(r)           ((r) & (BANK_MASK|ADDR_MASK))
+
+//not named in ENC28J60Registers.h as the driver has no use for them
+#define ERXWRPT_REG      0x0E
+#define PHSTAT2_LSTAT    0x0400
+#define TSV_DONE         0x80   //byte 2 of the transmit status vector
+#define RSV_RECEIVED_OK  0x80   //byte 4 of the receive status vector
+#define RSV_MULTICAST    0x01   //byte 5
+#define RSV_BROADCAST    0x02   //byte 5
+
+//the controller pads short frames to this when MACON3.PADCFG0 is set
+#define MIN_FRAMELEN     60
+#define MAX_FRAMELEN     1536
+
+static ENC28J60Sim* chips[ENC28J60SIM_CHIPS];
+static uint8_t chipPins[ENC28J60SIM_CHIPS];
+static ENC28J60Sim* selectedChip = NULL;
+
+/* ======================================================================= */
+/*                            I N I T I A L I Z E                          */
+/* ======================================================================= */
+ENC28J60Sim::ENC28J60Sim(uint8_t* mac, VirtualSwitch* vswitch,
+			 uint8_t csPin){
+
+  this->csPin = csPin;
+  this->port = new VirtualLinkDriver(mac,vswitch);
+  this->selected = false;
+  this->opcode = 0;
+  this->position = 0;
+  this->dmaLatency = 0;
+  this->transmitLatency = 0;
+  this->framesSent = 0;
+  this->framesReceived = 0;
+  this->framesDropped = 0;
+
+  memset(memory,0,sizeof(memory));
+  resetSPIStats();
+  reset();
+
+  //take the first free place on the bus
+  for(uint8_t i=0; i<ENC28J60SIM_CHIPS; i++){
+    if (chips[i] == NULL){
+      chips[i] = this;
+      chipPins[i] = csPin;
+      return;
+    }
+  }
+#ifdef DEBUG
+  fprintf(stderr,"No room on the bus for an ENC28J60Sim on pin %u\n",csPin);
+#endif
+}
+
+ENC28J60Sim::~ENC28J60Sim(){
+  for(uint8_t i=0; i<ENC28J60SIM_CHIPS; i++)
+    if (chips[i] == this) chips[i] = NULL;
+  if (selectedChip == this) selectedChip = NULL;
+  delete port;
+}
+
+//the power on (and soft reset) state, as far as the driver can tell
+void ENC28J60Sim::reset(){
+  memset(registers,0,sizeof(registers));
+  memset(phy,0,sizeof(phy));
+
+  *registerAt(ECON2) = ECON2_AUTOINC;
+  *registerAt(ESTAT) = ESTAT_CLKRDY;
+  setRegister16(ERDPT,0x05FA);
+  setRegister16(ERXST,0x05FA);
+  setRegister16(ERXND,0x1FFF);
+  setRegister16(ERXRDPT,0x05FA);
+  receiveWrite = 0x05FA;
+  *registerAt(ERXFCON) = ERXFCON_UCEN|ERXFCON_CRCEN|ERXFCON_BCEN;
+  setRegister16(REG(MAMXFL),0x0600);
+  *registerAt(EREVID) = 6;  //rev B7
+
+  phy[PHHID1] = 0x0083;
+  phy[PHHID2] = 0x1400;
+
+  dmaRemaining = 0;
+  transmitRemaining = 0;
+}
+
+/* ======================================================================= */
+/*                                T H E    B U S                           */
+/* ======================================================================= */
+void ENC28J60Sim::setPin(uint8_t pin, bool high){
+  for(uint8_t i=0; i<ENC28J60SIM_CHIPS; i++){
+    if (chips[i] == NULL || chipPins[i] != pin) continue;
+    if (!high && selectedChip == NULL){
+      selectedChip = chips[i];
+      selectedChip->select();
+    }
+    else if (high && selectedChip == chips[i]){
+      selectedChip->deselect();
+      selectedChip = NULL;
+    }
+    return;
+  }
+}
+
+uint8_t ENC28J60Sim::transfer(uint8_t data){
+  if (selectedChip == NULL) return 0xFF; //nothing is driving MISO
+  return selectedChip->clock(data);
+}
+
+//each transaction moves the engines along and lets in any frames that
+//have arrived on the port
+void ENC28J60Sim::select(){
+  selected = true;
+  position = 0;
+  stats.transactions++;
+
+  if (dmaRemaining > 0 && --dmaRemaining == 0)
+    runDMA();
+  if (transmitRemaining > 0 && --transmitRemaining == 0)
+    transmit();
+
+  pollPort();
+}
+
+void ENC28J60Sim::deselect(){
+  selected = false;
+}
+
+//one byte in from MOSI, one byte out on MISO (section 4.2)
+uint8_t ENC28J60Sim::clock(uint8_t data){
+  stats.bytes++;
+
+  if (position++ == 0){
+    opcode = data;
+    switch(opcode >> 5){
+    case 0: stats.registerReads++; break;
+    case 1: stats.bufferReads++; break;
+    case 2: stats.registerWrites++; break;
+    case 3: stats.bufferWrites++; break;
+    case 4:
+    case 5: stats.bitFieldOps++; break;
+    case 7: reset(); break;
+    }
+    return 0;
+  }
+
+  //the bank applies to everything below the common registers
+  uint8_t argument = opcode & ADDR_MASK;
+  uint8_t address = argument;
+  if (argument < EIE)
+    address |= (registers[0][ECON1] & (ECON1_BSEL1|ECON1_BSEL0)) << 5;
+
+  switch(opcode >> 5){
+
+  case 0: //read control register; MAC and MII registers send a dummy first
+    if (position == 2 && isMACRegister(address)) return 0;
+    return readRegister(address);
+
+  case 1: //read buffer memory
+    {
+      if (argument != 0x1A) return 0;
+      uint16_t pointer = getRegister16(ERDPT);
+      uint8_t d = memory[pointer & (ENC28J60SIM_MEMORY - 1)];
+      if (registers[0][ECON2] & ECON2_AUTOINC)
+	setRegister16(ERDPT,nextAddress(pointer,true));
+      stats.bufferBytesRead++;
+      return d;
+    }
+
+  case 2: //write control register
+    if (position != 2) return 0;
+    if (address == ECON1 &&
+	((data ^ registers[0][ECON1]) & (ECON1_BSEL1|ECON1_BSEL0)))
+      stats.bankSelects++;
+    writeRegister(address,data);
+    return 0;
+
+  case 3: //write buffer memory
+    {
+      if (argument != 0x1A) return 0;
+      uint16_t pointer = getRegister16(EWRPT);
+      memory[pointer & (ENC28J60SIM_MEMORY - 1)] = data;
+      if (registers[0][ECON2] & ECON2_AUTOINC)
+	setRegister16(EWRPT,nextAddress(pointer,false));
+      stats.bufferBytesWritten++;
+      return 0;
+    }
+
+  case 4: //bit field set and clear; Ethernet registers only
+  case 5:
+    if (position != 2 || isMACRegister(address)) return 0;
+    if (address == ECON1 && (data & (ECON1_BSEL1|ECON1_BSEL0)))
+      stats.bankSelects++;
+    if ((opcode >> 5) == 4)
+      writeRegister(address,readRegister(address) | data);
+    else
+      writeRegister(address,readRegister(address) & ~data);
+    return 0;
+  }
+
+  return 0;
+}
+
+/* ======================================================================= */
+/*                            R E G I S T E R S                            */
+/* ======================================================================= */
+
+//the MAC and MII registers (section 3.1) answer a read a byte late
+bool ENC28J60Sim::isMACRegister(uint8_t address){
+  uint8_t bank = (address & BANK_MASK) >> 5;
+  address &= ADDR_MASK;
+  if (bank == 2) return address <= 0x19;
+  if (bank == 3) return address <= 0x05 || address == 0x0A;
+  return false;
+}
+
+uint8_t* ENC28J60Sim::registerAt(uint8_t address){
+  uint8_t a = address & ADDR_MASK;
+  if (a >= EIE) return &registers[0][a];
+  return &registers[(address & BANK_MASK) >> 5][a];
+}
+
+uint16_t ENC28J60Sim::getRegister16(uint8_t address){
+  return *registerAt(address) | (*registerAt(address+1) << 8);
+}
+
+void ENC28J60Sim::setRegister16(uint8_t address, uint16_t value){
+  *registerAt(address) = value & 0xFF;
+  *registerAt(address+1) = value >> 8;
+}
+
+uint8_t ENC28J60Sim::readRegister(uint8_t address){
+  address = REG(address);
+  if (address == ERXWRPT_REG) return receiveWrite & 0xFF;
+  if (address == ERXWRPT_REG+1) return receiveWrite >> 8;
+  return *registerAt(address);
+}
+
+void ENC28J60Sim::writeRegister(uint8_t address, uint8_t value){
+  address = REG(address);
+  uint8_t* r = registerAt(address);
+  uint8_t old = *r;
+
+  //read only, or not written by the driver
+  if (address == REG(EPKTCNT) || address == REG(EREVID) ||
+      address == REG(MISTAT) || address == REG(MIRD) ||
+      address == REG(MIRD)+1 || address == ERXWRPT_REG ||
+      address == ERXWRPT_REG+1)
+    return;
+
+  if (address == ESTAT){
+    *r = (old & ~(ESTAT_TXABRT|ESTAT_LATECOL)) | ESTAT_CLKRDY;
+    return;
+  }
+
+  *r = value;
+
+  if (address == ECON1){
+    if (value & ECON1_TXRST){
+      transmitRemaining = 0;
+      *r &= ~ECON1_TXRTS;
+    }
+    if ((value & ~old) & ECON1_DMAST){
+      dmaRemaining = dmaLatency;
+      if (dmaLatency == 0) runDMA();
+    }
+    if ((value & ~old) & ECON1_TXRTS && !(value & ECON1_TXRST)){
+      transmitRemaining = transmitLatency;
+      if (transmitLatency == 0) transmit();
+    }
+  }
+  else if (address == ECON2){
+    //PKTDEC always reads back as 0
+    if ((value & ECON2_PKTDEC) && *registerAt(EPKTCNT) > 0)
+      (*registerAt(EPKTCNT))--;
+    *r &= ~ECON2_PKTDEC;
+  }
+  else if (address == ERXST || address == ERXST+1){
+    //writing ERXST moves ERXWRPT with it (section 6.1)
+    receiveWrite = getRegister16(ERXST);
+  }
+  else if (address == REG(MICMD)){
+    if (value & MICMD_MIIRD){
+      uint8_t reg = *registerAt(REG(MIREGADR)) & 0x1F;
+      uint16_t d = phy[reg];
+      if (reg == PHSTAT2 && port->isLinkUp()) d |= PHSTAT2_LSTAT;
+      setRegister16(REG(MIRD),d);
+    }
+  }
+  else if (address == REG(MIWR)+1){
+    //the PHY write starts when the high byte is written
+    phy[*registerAt(REG(MIREGADR)) & 0x1F] = getRegister16(REG(MIWR));
+  }
+}
+
+/* ======================================================================= */
+/*                           B U F F E R     M E M O R Y                   */
+/* ======================================================================= */
+bool ENC28J60Sim::inReceiveRing(uint16_t address){
+  return address >= getRegister16(ERXST) && address <= getRegister16(ERXND);
+}
+
+//the address after address, wrapping at the end of the receive ring
+//when reading from it (section 3.2.2)
+uint16_t ENC28J60Sim::nextAddress(uint16_t address, bool receiveRing){
+  if (receiveRing && address == getRegister16(ERXND))
+    return getRegister16(ERXST);
+  return (address + 1) & (ENC28J60SIM_MEMORY - 1);
+}
+
+//copy or checksum EDMAST..EDMAND; a source in the receive ring wraps
+//(section 13)
+void ENC28J60Sim::runDMA(){
+  uint16_t source = getRegister16(EDMAST);
+  uint16_t end = getRegister16(EDMAND);
+  bool ring = inReceiveRing(source);
+  uint8_t* econ1 = registerAt(ECON1);
+
+  if (*econ1 & ECON1_CSUMEN){
+    uint32_t sum = 0;
+    bool high = true;
+    for(uint16_t n=0; n<ENC28J60SIM_MEMORY; n++){
+      sum += high ? (memory[source] << 8) : memory[source];
+      high = !high;
+      if (source == end) break;
+      source = nextAddress(source,ring);
+    }
+    while (sum >> 16)
+      sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = ~sum & 0xFFFF;
+    //EDMACSH holds the byte that goes on the wire first
+    *registerAt(EDMACS) = sum & 0xFF;
+    *registerAt(EDMACS+1) = sum >> 8;
+  }
+  else {
+    uint16_t destination = getRegister16(EDMADST);
+    for(uint16_t n=0; n<ENC28J60SIM_MEMORY; n++){
+      memory[destination] = memory[source];
+      destination = nextAddress(destination,false);
+      if (source == end) break;
+      source = nextAddress(source,ring);
+    }
+  }
+
+  *econ1 &= ~ECON1_DMAST;
+  *registerAt(EIR) |= EIR_DMAIF;
+}
+
+/* ======================================================================= */
+/*                    S E N D      A N D      R E C E I V E                */
+/* ======================================================================= */
+
+//send ETXST+1..ETXND (ETXST holds the control byte) and leave the
+//transmit status vector after it (section 7.1)
+void ENC28J60Sim::transmit(){
+  uint16_t start = getRegister16(ETXST);
+  uint16_t end = getRegister16(ETXND);
+  uint16_t len = end > start ? end - start : 0;
+
+  static uint8_t frame[MAX_FRAMELEN];
+  if (len > MAX_FRAMELEN) len = MAX_FRAMELEN;
+  for(uint16_t i=0; i<len; i++)
+    frame[i] = memory[(start + 1 + i) & (ENC28J60SIM_MEMORY - 1)];
+
+  if (len < MIN_FRAMELEN &&
+      (*registerAt(REG(MACON3)) & MACON3_PADCFG0)){
+    memset(frame+len,0,MIN_FRAMELEN-len);
+    len = MIN_FRAMELEN;
+  }
+
+  if (len > 0 && len <= VLINK_MAX_FRAMELEN &&
+      port->getSendBuffer()->write(0,frame,len)){
+    port->sendFrame(len);
+    framesSent++;
+  }
+
+  uint8_t status[7];
+  memset(status,0,sizeof(status));
+  status[0] = len & 0xFF;
+  status[1] = len >> 8;
+  status[2] = TSV_DONE;
+  for(uint8_t i=0; i<sizeof(status); i++)
+    memory[(end + 1 + i) & (ENC28J60SIM_MEMORY - 1)] = status[i];
+
+  *registerAt(ECON1) &= ~ECON1_TXRTS;
+  *registerAt(EIR) |= EIR_TXIF;
+}
+
+void ENC28J60Sim::pollPort(){
+  while (port->getPendingFrames() > 0){
+    uint16_t len = port->receiveFrame();
+    if (len > 0)
+      receive(port->getReceiveBuffer()->span(0,len),len);
+  }
+}
+
+//the receive filters of section 8.  With every
+//filter off the controller takes everything
+bool ENC28J60Sim::accept(const uint8_t* frame, uint16_t len){
+  uint8_t filters = *registerAt(ERXFCON);
+  if ((filters & ~(ERXFCON_ANDOR|ERXFCON_CRCEN)) == 0) return true;
+  if (len < 6) return false;
+
+  static const uint8_t broadcastMAC[6] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+  uint8_t mac[6];
+  mac[0] = *registerAt(REG(MAADR5));
+  mac[1] = *registerAt(REG(MAADR4));
+  mac[2] = *registerAt(REG(MAADR3));
+  mac[3] = *registerAt(REG(MAADR2));
+  mac[4] = *registerAt(REG(MAADR1));
+  mac[5] = *registerAt(REG(MAADR0));
+
+  bool broadcast = memcmp(frame,broadcastMAC,6) == 0;
+  bool multicast = !broadcast && (frame[0] & 0x01);
+  bool unicast = memcmp(frame,mac,6) == 0;
+
+  uint8_t passed = 0;
+  uint8_t enabled = filters & ~(ERXFCON_ANDOR|ERXFCON_CRCEN);
+  if (unicast) passed |= ERXFCON_UCEN;
+  if (multicast) passed |= ERXFCON_MCEN;
+  if (broadcast) passed |= ERXFCON_BCEN;
+  if (enabled & ERXFCON_HTEN){
+    uint8_t bit = hashPointer(frame);
+    if (*registerAt(EHT0 + (bit >> 3)) & (1 << (bit & 7)))
+      passed |= ERXFCON_HTEN;
+  }
+  if ((enabled & ERXFCON_PMEN) && matchPattern(frame,len))
+    passed |= ERXFCON_PMEN;
+  if ((enabled & ERXFCON_MPEN) && isMagicPacket(frame,len,mac))
+    passed |= ERXFCON_MPEN;
+  passed &= enabled;
+
+  if (filters & ERXFCON_ANDOR) return passed == enabled;
+  return passed != 0;
+}
+
+//bits 28:23 of the CRC of the destination address (section 8.2.4).
+//Worked out here on its own, from the reflected CRC the FCS is usually
+//computed with, reversed into the order the MAC holds it, so that the
+//driver's hashAddress is checked rather than copied
+uint8_t ENC28J60Sim::hashPointer(const uint8_t* address){
+  uint32_t reflected = 0xFFFFFFFF;
+  for(uint8_t i=0; i<6; i++){
+    reflected ^= address[i];
+    for(uint8_t bit=0; bit<8; bit++)
+      reflected = (reflected >> 1) ^ ((reflected & 1) ? 0xEDB88320UL : 0);
+  }
+  uint32_t crc = 0;
+  for(uint8_t bit=0; bit<32; bit++)
+    if (reflected & ((uint32_t)1 << bit)) crc |= (uint32_t)1 << (31 - bit);
+  return (crc >> 23) & 0x3F;
+}
+
+//the bytes of the 64 byte window at EPMO picked out by EPMM are
+//checksummed as though they sat side by side and compared with EPMCS.
+//A frame that ends before a picked byte does not match
+bool ENC28J60Sim::matchPattern(const uint8_t* frame, uint16_t len){
+  uint16_t start = getRegister16(EPMO) & 0x1FFF;
+  uint32_t sum = 0;
+  bool high = true;
+  for(uint8_t b=0; b<64; b++){
+    if (!(*registerAt(EPMM0 + (b >> 3)) & (1 << (b & 7)))) continue;
+    if (start + b >= len) return false;
+    sum += high ? (uint16_t)frame[start + b] << 8 : frame[start + b];
+    high = !high;
+  }
+  while (sum >> 16)
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  return (uint16_t)~sum == getRegister16(EPMCS);
+}
+
+//six 0xFF bytes followed by our MAC sixteen times, anywhere after the
+//header
+bool ENC28J60Sim::isMagicPacket(const uint8_t* frame, uint16_t len,
+				const uint8_t* mac){
+  for(uint16_t i=14; i + 6 + 16*6 <= len; i++){
+    uint8_t n;
+    for(n=0; n<6 && frame[i+n] == 0xFF; n++)
+      ;
+    if (n < 6) continue;
+    for(n=0; n<16 && memcmp(frame+i+6+n*6,mac,6) == 0; n++)
+      ;
+    if (n == 16) return true;
+  }
+  return false;
+}
+
+//each frame is preceded by the next packet pointer and the receive
+//status vector, followed by the CRC, and padded to an even address
+//(section 7.2)
+bool ENC28J60Sim::receive(const uint8_t* frame, uint16_t len){
+  if (!(*registerAt(ECON1) & ECON1_RXEN)) return false;
+  if (!accept(frame,len)) return false;
+
+  uint16_t ringStart = getRegister16(ERXST);
+  uint16_t ringEnd = getRegister16(ERXND);
+  uint16_t ringSize = ringEnd - ringStart + 1;
+  uint16_t readPointer = getRegister16(ERXRDPT);
+
+  //the controller may write up to, but not onto, ERXRDPT
+  uint16_t used = receiveWrite >= readPointer ?
+    receiveWrite - readPointer : ringSize - (readPointer - receiveWrite);
+  uint16_t free = ringSize - used - 1;
+
+  uint16_t total = 6 + len + 4;
+  total += total & 1;
+  if (total > free || *registerAt(EPKTCNT) == 0xFF){
+    framesDropped++;
+    *registerAt(EIR) |= EIR_RXERIF;
+    return false;
+  }
+
+  uint16_t next = receiveWrite + total;
+  if (next > ringEnd) next -= ringSize;
+
+  uint8_t header[6];
+  header[0] = next & 0xFF;
+  header[1] = next >> 8;
+  header[2] = (len + 4) & 0xFF;
+  header[3] = (len + 4) >> 8;
+  header[4] = RSV_RECEIVED_OK;
+  header[5] = 0;
+  if (len >= 6 && (frame[0] & 0x01))
+    header[5] = frame[0] == 0xFF && frame[1] == 0xFF ?
+      RSV_BROADCAST : RSV_MULTICAST;
+
+  uint16_t w = receiveWrite;
+  for(uint16_t i=0; i<total; i++){
+    uint8_t d = 0;  //the CRC and padding are left as zero
+    if (i < 6) d = header[i];
+    else if (i < 6 + len) d = frame[i-6];
+    memory[w] = d;
+    w = nextAddress(w,true);
+  }
+
+  receiveWrite = next;
+  (*registerAt(EPKTCNT))++;
+  *registerAt(EIR) |= EIR_PKTIF;
+  framesReceived++;
+  return true;
+}
+
+/* ======================================================================= */
+/*                                A C C E S S O R S                        */
+/* ======================================================================= */
+void ENC28J60Sim::setDMALatency(uint16_t transactions){
+  dmaLatency = transactions;
+}
+
+void ENC28J60Sim::setTransmitLatency(uint16_t transactions){
+  transmitLatency = transactions;
+}
+
+enc28j60SPIStats* ENC28J60Sim::getSPIStats(){ return &stats; }
+
+void ENC28J60Sim::resetSPIStats(){
+  memset(&stats,0,sizeof(stats));
+}
+
+uint32_t ENC28J60Sim::getFramesSent(){ return framesSent; }
+uint32_t ENC28J60Sim::getFramesReceived(){ return framesReceived; }
+uint32_t ENC28J60Sim::getFramesDropped(){ return framesDropped; }
+uint8_t* ENC28J60Sim::getMemory(){ return memory; }
+VirtualLinkDriver* ENC28J60Sim::getPort(){ return port; }
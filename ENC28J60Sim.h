@@ -0,0 +1,153 @@
+/*
+ *  A software model of the ENC28J60, detailed enough for the real
+ *  ENC28J60Driver to run against it on the host.  The driver is built
+ *  unchanged; on the host its SPI port, chip select pin and the rest of
+ *  the Arduino core it uses come from ENC28J60SimArduino.h and are wired
+ *  to the simulated controller selected by the pin.
+ *
+ *  The model covers what the driver relies on:
+ *
+ *    - the SPI command set (RCR, RBM, WCR, WBM, BFS, BFC, SRC), including
+ *      the dummy byte MAC and MII registers return
+ *    - the four register banks and the common registers
+ *    - 8 KB of buffer memory with ERDPT/EWRPT auto increment, ERDPT
+ *      wrapping at the end of the receive ring
+ *    - the receive ring, EPKTCNT and PKTDEC, and the ERXFCON filters:
+ *      unicast, multicast, broadcast, hash table, pattern match and
+ *      magic packet
+ *    - the DMA engine, copying or checksumming
+ *    - the transmit engine (TXRTS and the transmit status vector)
+ *    - the PHY registers behind MIREGADR/MICMD/MIWR/MIRD
+ *
+ *  The controller is plugged into a VirtualSwitch, so a stack running on
+ *  the real driver can talk to stacks on VirtualLinkDrivers or on other
+ *  simulated controllers:
+ *
+ *     VirtualSwitch sw;
+ *     ENC28J60Sim chip(macA,&sw,10);           //before the driver
+ *     ENC28J60Driver* driver = new ENC28J60Driver(macA,10);
+ *     ...
+ *     chip.resetSPIStats();
+ *     udp->sendDatagram(...);
+ *     printf("%u bytes over SPI\n",chip.getSPIStats()->bytes);
+ *
+ *  Every byte and transaction on the bus is counted, which is the point:
+ *  on a board the SPI bus, not the CPU, is what sending and receiving
+ *  costs, and the counts are exact and repeatable where timings are not.
+ *
+ *  The DMA and transmit engines finish instantly unless given a latency,
+ *  counted in SPI transactions, in which case DMAST and TXRTS stay set
+ *  and the work is done when the latency runs out; that exercises the
+ *  driver's handling of copies and frames still in flight.
+ *
+ *  Anything the driver does not use (interrupts, flow control, the
+ *  built-in self test, power saving) is not modelled.
+ */
+#ifndef ENC28J60SIM_H
+#define ENC28J60SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <VirtualSwitch.h>
+#include <VirtualLinkDriver.h>
+
+#define ENC28J60SIM_MEMORY   8192
+
+//the number of controllers that may be on the bus at once
+#define ENC28J60SIM_CHIPS    4
+
+typedef struct enc28j60SPIStats {
+  uint32_t transactions;       //times the chip was selected
+  uint32_t bytes;              //bytes clocked, command bytes included
+  uint32_t registerReads;      //RCR
+  uint32_t registerWrites;     //WCR
+  uint32_t bitFieldOps;        //BFS and BFC
+  uint32_t bankSelects;        //register writes that touched ECON1.BSEL
+  uint32_t bufferReads;        //RBM
+  uint32_t bufferWrites;       //WBM
+  uint32_t bufferBytesRead;    //data bytes, not counting the command
+  uint32_t bufferBytesWritten;
+} enc28j60SPIStats;
+
+class ENC28J60Sim {
+
+  uint8_t csPin;
+  VirtualLinkDriver* port;
+
+  uint8_t memory[ENC28J60SIM_MEMORY];
+  uint8_t registers[4][32];   //the common registers are kept in bank 0
+  uint16_t phy[32];
+  uint16_t receiveWrite;      //ERXWRPT
+
+  //the SPI transaction under way
+  bool selected;
+  uint8_t opcode;
+  uint16_t position;          //bytes clocked since the chip was selected
+
+  //work still in progress, in transactions
+  uint16_t dmaLatency;
+  uint16_t dmaRemaining;
+  uint16_t transmitLatency;
+  uint16_t transmitRemaining;
+
+  enc28j60SPIStats stats;
+  uint32_t framesSent;
+  uint32_t framesReceived;
+  uint32_t framesDropped;
+
+  void reset();
+  void select();
+  void deselect();
+  uint8_t clock(uint8_t data);
+
+  static bool isMACRegister(uint8_t address);
+  uint8_t* registerAt(uint8_t address);
+  uint16_t getRegister16(uint8_t address);
+  void setRegister16(uint8_t address, uint16_t value);
+  uint8_t readRegister(uint8_t address);
+  void writeRegister(uint8_t address, uint8_t value);
+
+  uint16_t nextAddress(uint16_t address, bool receiveRing);
+  bool inReceiveRing(uint16_t address);
+  void runDMA();
+  void transmit();
+  void pollPort();
+  bool accept(const uint8_t* frame, uint16_t len);
+  static uint8_t hashPointer(const uint8_t* address);
+  bool matchPattern(const uint8_t* frame, uint16_t len);
+  bool isMagicPacket(const uint8_t* frame, uint16_t len, const uint8_t* mac);
+
+ public:
+  ENC28J60Sim(uint8_t* mac, VirtualSwitch* vswitch = NULL,
+	      uint8_t csPin = 10);
+  ~ENC28J60Sim();
+
+  //put a frame in the receive ring as though it had come off the wire.
+  //False if the controller is not receiving, the filters turn it away
+  //or the ring is full (which is counted as a drop)
+  bool receive(const uint8_t* frame, uint16_t len);
+
+  //how long, in SPI transactions, a DMA operation or a transmission
+  //takes.  0 (the default) finishes it as soon as it is started
+  void setDMALatency(uint16_t transactions);
+  void setTransmitLatency(uint16_t transactions);
+
+  enc28j60SPIStats* getSPIStats();
+  void resetSPIStats();
+
+  uint32_t getFramesSent();
+  uint32_t getFramesReceived();
+  uint32_t getFramesDropped();
+
+  //the buffer memory, for checking what the driver left there
+  uint8_t* getMemory();
+  VirtualLinkDriver* getPort();
+
+  //the bus, as driven by ENC28J60SimArduino.h: the chip on pin is
+  //selected while the pin is low, and transfer clocks a byte to and
+  //from the selected chip
+  static void setPin(uint8_t pin, bool high);
+  static uint8_t transfer(uint8_t data);
+};
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ *  The few parts of the Arduino core ENC28J60Driver uses, for building
+ *  it on the host against ENC28J60Sim.  The SPI data register clocks a
+ *  byte through whichever simulated controller has its chip select pin
+ *  low, and the transfer is always complete by the time SPSR is read.
+ *  Delays and interrupts are no-ops.
+ *
+ *  Only the driver includes this header, in place of Arduino.h; the
+ *  SPI pins (10 to 13 as on an Uno) are driven by the driver's initSPI,
+ *  so a simulated controller should be given a different select pin,
+ *  or the default of 10 (SS, which is only ever driven high).
+ */
+#ifndef ENC28J60SIMARDUINO_H
+#define ENC28J60SIMARDUINO_H
+
+#include <stdint.h>
+#include <ENC28J60Sim.h>
+
+typedef uint8_t byte;
+
+#define LOW     0
+#define HIGH    1
+#define INPUT   0
+#define OUTPUT  1
+
+#define SS      10
+#define MOSI    11
+#define MISO    12
+#define SCK     13
+
+//SPCR and SPSR bits
+#define SPE     6
+#define MSTR    4
+#define SPIF    7
+#define SPI2X   0
+
+#define bit(b) (1UL << (b))
+#define bitRead(value, b) (((value) >> (b)) & 0x01)
+#define bitSet(value, b) ((value) |= (1UL << (b)))
+
+class ENC28J60SimDataRegister {
+  uint8_t received;
+ public:
+  ENC28J60SimDataRegister(): received(0) {}
+  ENC28J60SimDataRegister& operator=(uint8_t data){
+    received = ENC28J60Sim::transfer(data);
+    return *this;
+  }
+  operator uint8_t() const { return received; }
+};
+
+extern ENC28J60SimDataRegister SPDR;
+extern uint8_t SPCR;
+extern uint8_t SPSR;
+
+static inline void pinMode(uint8_t pin, uint8_t mode){}
+static inline void digitalWrite(uint8_t pin, uint8_t value){
+  ENC28J60Sim::setPin(pin,value != LOW);
+}
+static inline void delay(unsigned long ms){}
+static inline void cli(){}
+static inline void sei(){}
+
+#endif
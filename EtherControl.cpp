@@ -1,15 +1,17 @@
 // 2013-10-01 <doug@powersline.com>
 
 #include <hostutil.h>
+#include <string.h>
+#include <Headers.h>
 #include "EtherControl.h"
 
+#if defined(ARDUINO)
 #if ARDUINO >= 100
 #include <Arduino.h> // Arduino 1.0
 #else
 #include <Wprogram.h> // Arduino 0022
 #endif
-
-//#define EMULATE_PACKET_LOSS_PCT 25
+#endif
 
 #define MAC_SIZE 6
 #define HEADER_LENGTH (MAC_SIZE*2 + sizeof(uint16_t))
@@ -60,6 +62,39 @@ PayloadHandler* EtherControl::getProtocolHandler(uint16_t etherType){
   return NULL;
 }//end getProtocolHandler
 
+bool EtherControl::setReceiveFilter(uint8_t extra, const uint8_t *hashTable){
+  receiveFilter filter;
+  memset(&filter,0,sizeof(filter));
+  filter.accept = RECEIVE_UNICAST | extra;
+  if (hashTable != NULL)
+    memcpy(filter.hashTable,hashTable,sizeof(filter.hashTable));
+
+  uint8_t wanted = 0;
+  for(int i=0; i<protocolCapacity; i++){
+    if (protocolRegistry[i].etherType == 0) continue;
+
+    receivePattern pattern;
+    uint8_t type[2];
+    Buffer::putNet16(type,protocolRegistry[i].etherType);
+    pattern.length = 0;
+    EthernetDriver::addToPattern(&pattern,
+				 EthernetHeader::Destination::offset,
+				 broadcastMAC,MAC_SIZE);
+    EthernetDriver::addToPattern(&pattern,EthernetHeader::Protocol::offset,
+				 type,sizeof(type));
+    if (!protocolRegistry[i].handler->matchBroadcasts(&pattern)) continue;
+
+    if (wanted++ == 0) filter.pattern = pattern;
+  }
+
+  if (wanted == 1)
+    filter.accept |= RECEIVE_PATTERN;
+  else if (wanted > 1)
+    filter.accept |= RECEIVE_BROADCAST;
+
+  return driver->setReceiveFilter(&filter);
+}//end setReceiveFilter
+
 /* ========================================================================= */
 /*                      T I M E R    R E G I S T R A T I O N                 */
 /* ========================================================================= */
@@ -110,6 +145,23 @@ void EtherControl::processTimers(){
   }//end for
 }//end processTimers
 
+uint32_t EtherControl::getMillisToNextTimer(){
+  uint32_t next = 0xFFFFFFFF;
+  uint32_t now = host_millis();
+  int i;
+  for(i=0; i<timerCapacity; i++){
+    if (timerRegistry[i].handler == NULL) continue;
+
+    //a timer fires once more than delayTime has elapsed
+    uint32_t elapsed = now - timerRegistry[i].startTime;
+    if (elapsed > timerRegistry[i].delayTime) return 0;
+
+    uint32_t remaining = timerRegistry[i].delayTime - elapsed + 1;
+    if (remaining < next) next = remaining;
+  }//end for
+  return next;
+}//end getMillisToNextTimer
+
 
 EtherControl::EtherControl (EthernetDriver *driver, 
 			    uint8_t protocolCapacity,
@@ -121,6 +173,7 @@ EtherControl::EtherControl (EthernetDriver *driver,
   hostinit();
 
   this->driver = driver;
+  this->capture = NULL;
 
   //initialize the payload buffer
   //the frame starts with 2 mac addresses (6 uint8_ts each)
@@ -168,12 +221,8 @@ Buffer* EtherControl::getSendPayloadBuffer(){
   return sendPayloadBuffer;
 }
 
-bool EtherControl::sendFrame(const uint8_t *destinationMAC, uint16_t protocol, 
-			     uint16_t payloadLength){
-
-#ifdef EMULATE_PACKET_LOSS_PCT
-  if ((random() % 100) + 1 < EMULATE_PACKET_LOSS_PCT) return true;
-#endif
+bool EtherControl::writeHeader(const uint8_t *destinationMAC, 
+			      uint16_t protocol, uint16_t payloadLength){
 
   Buffer* sendBuffer = driver->getSendBuffer();
 
@@ -181,25 +230,48 @@ bool EtherControl::sendFrame(const uint8_t *destinationMAC, uint16_t protocol,
   if (payloadLength > sendBuffer->size() - HEADER_LENGTH)
     return false; //too big
 
-  //set the mac_dest
-  bool e = sendBuffer->write(0,(void*)destinationMAC,MAC_SIZE);
-  if (!e) return false;
+  //build the header in place if we can, otherwise write it in one go
+  Header<EthernetHeader> header;
+  header.place(sendBuffer);
+  header.set<EthernetHeader::Destination>(destinationMAC);
+  header.set<EthernetHeader::Source>(this->driver->getMACAddr());
+  header.set<EthernetHeader::Protocol>(protocol);
+  if (!header.store(sendBuffer)) return false;
 
-  //set the mac_src
-  e = sendBuffer->write(MAC_SIZE,this->driver->getMACAddr(),MAC_SIZE);
-  if (!e) return false;
+  return true;
+}
 
-  //set the protocol
-  e = sendBuffer->writeNet16(MAC_SIZE+MAC_SIZE,protocol);
-  if (!e) return false;
+bool EtherControl::sendFrame(const uint8_t *destinationMAC, uint16_t protocol, 
+			     uint16_t payloadLength){
+
+  if (!writeHeader(destinationMAC,protocol,payloadLength)) return false;
 
   //payload should already be set
   //so just send the packet
+  Buffer* sendBuffer = driver->getSendBuffer();
   uint16_t frame_len = HEADER_LENGTH+payloadLength;
+  if (capture != NULL)
+    capture->record(sendBuffer,frame_len);
   driver->sendFrame(frame_len);
   return true;
 }
 
+bool EtherControl::sendFrame(const uint8_t *destinationMAC, uint16_t protocol, 
+			     BufferChain *payload){
+
+  if (!writeHeader(destinationMAC,protocol,payload->size())) return false;
+
+  //the frame is our header followed by the payload, wherever it is
+  if (!payload->prepend(driver->getSendBuffer(),0,HEADER_LENGTH))
+    return false;
+
+  uint16_t frame_len = payload->size();
+  if (capture != NULL)
+    capture->record(payload,frame_len);
+  driver->sendGatheredFrame(payload,frame_len);
+  return true;
+}
+
 bool EtherControl::sendFrame(const uint8_t *destinationMAC, uint16_t protocol, 
 			     uint16_t length,uint8_t *payload){
 
@@ -213,33 +285,36 @@ bool EtherControl::sendFrame(const uint8_t *destinationMAC, uint16_t protocol,
   return this->sendFrame(destinationMAC,protocol,length);
 }//send frame
 
-bool EtherControl::processFrame(){
+//hand the frame of len bytes in the receive buffer to its handler
+bool EtherControl::dispatchFrame(uint16_t len){
   Buffer* recvBuffer = driver->getReceiveBuffer();
 
-  uint16_t len = driver->receiveFrame();
+  if (capture != NULL)
+    capture->record(recvBuffer,len);
 
-#ifdef EMULATE_PACKET_LOSS_PCT
-  if ((random() % 100) + 1 < EMULATE_PACKET_LOSS_PCT) return true;
-#endif
-  
-  if (len > 0){
-    
-    //we have a frame, get the etherType
-    uint16_t etherType;
-    if (!recvBuffer->readNet16(MAC_SIZE*2,&etherType)) return false;
+  //we have a frame, get the etherType
+  uint16_t etherType;
+  if (!recvBuffer->readNet16(MAC_SIZE*2,&etherType)) return false;
+
+  //lookup the handler for the etherType
+  PayloadHandler *handler = getProtocolHandler(etherType);
 
-    //lookup the handler for the etherType
-    PayloadHandler *handler = getProtocolHandler(etherType);
+  //if we found a handler, call it with the payload
+  if (handler != NULL){
+    uint16_t payloadLength = len - HEADER_LENGTH;
+    OffsetBuffer frameBuffer = OffsetBuffer(recvBuffer,HEADER_LENGTH,
+					    payloadLength);
+    handler->handlePayload(&frameBuffer);
+  }//done calling handler
 
-    //if we found a handler, call it with the payload
-    if (handler != NULL){
-      uint16_t payloadLength = len - HEADER_LENGTH;
-      OffsetBuffer frameBuffer = OffsetBuffer(recvBuffer,HEADER_LENGTH,
-					      payloadLength);
-      handler->handlePayload(&frameBuffer);
-    }//done calling handler
+  return true;
+}//end dispatchFrame
+
+bool EtherControl::processFrame(){
+  uint16_t len = driver->receiveFrame();
 
-  }//end if we have a frame
+  if (len > 0 && !dispatchFrame(len))
+    return false;
 
   //process our timers
   processTimers();
@@ -247,6 +322,37 @@ bool EtherControl::processFrame(){
   return true;
 }//end processFrame
 
+uint8_t EtherControl::processFrames(uint8_t budget, uint8_t* pending){
+  uint8_t handled = 0;
+  uint8_t misses = 0;
+
+  while (handled < budget){
+    uint16_t len = driver->receiveFrame();
+
+    //0 doesn't always mean the driver is empty: it also throws away
+    //frames that arrived damaged (or, impaired, were dropped or held
+    //back), so carry on while it says more are waiting.  Held frames
+    //count as waiting before they are due, so the misses are limited
+    //to the budget as well
+    if (len == 0){
+      if (++misses >= budget || driver->getPendingFrames() == 0) break;
+      continue;
+    }
+
+    //a frame we can't read is dropped; the rest are still worth having
+    dispatchFrame(len);
+    handled++;
+  }
+
+  //the timers run once however many frames there were
+  processTimers();
+
+  if (pending != NULL)
+    *pending = driver->getPendingFrames();
+
+  return handled;
+}//end processFrames
+
 uint16_t EtherControl::getMaxReceivePayload(){
   Buffer* recvBuffer = driver->getReceiveBuffer();
   return recvBuffer->size() - HEADER_LENGTH;
@@ -258,3 +364,11 @@ uint16_t EtherControl::getMaxReceivePayload(){
 uint8_t *EtherControl::getMACAddress(){
   return this->driver->getMACAddr();
 }
+
+void EtherControl::setCapture(FrameCapture *capture){
+  this->capture = capture;
+}
+
+FrameCapture* EtherControl::getCapture(){
+  return this->capture;
+}
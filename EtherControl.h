@@ -27,6 +27,14 @@
 //       function returns a byte reprenting the timer id.  Call
 //       unregisterTimer(byte) to disable and remove the timer.
 //
+// If the driver can filter frames in hardware, setReceiveFilter() has it
+// take only unicasts to us and the broadcasts the registered handlers
+// ask for (see PayloadHandler::matchBroadcasts), so the rest of the
+// traffic on the LAN never crosses to the controller's host.
+//
+// For tracing, a FrameCapture may be attached with setCapture().  Every
+// frame sent or received is then recorded into the capture's ring.
+//
 // 2013-10-01 <doug@powersline.com>
 
 #ifndef ETHERCONTROL_H
@@ -37,6 +45,8 @@
 #include <TimerHandler.h>
 #include <Buffer.h>
 #include <OffsetBuffer.h>
+#include <BufferChain.h>
+#include <FrameCapture.h>
 
 const uint8_t broadcastMAC[6] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
  
@@ -45,6 +55,12 @@ class PayloadHandler {
  public:
   virtual void handlePayload(Buffer *payload) = 0;
 
+  //the broadcasts this handler wants.  pattern arrives holding the
+  //broadcast address and the handler's etherType; add to it (see
+  //EthernetDriver::addToPattern) to narrow it, or return false if no
+  //broadcasts are wanted.  By default every one of the etherType is
+  virtual bool matchBroadcasts(receivePattern*){ return true; }
+
 };
 
 typedef struct protocolMap {
@@ -73,11 +89,15 @@ class EtherControl {
   
   EthernetDriver* driver;
   OffsetBuffer *sendPayloadBuffer;
+  FrameCapture *capture;
 
   void initProtocolRegistry();
   void initTimerRegistry();
   PayloadHandler* getProtocolHandler(uint16_t etherType);
   void processTimers();
+  bool dispatchFrame(uint16_t len);
+  bool writeHeader(const uint8_t *destinationMAC, uint16_t protocol,
+		   uint16_t length);
 
   uint8_t protocolCapacity;
   uint8_t timerCapacity;
@@ -94,15 +114,51 @@ class EtherControl {
 		 uint16_t length);
   bool sendFrame(const uint8_t *destinationMAC, 
 		 uint16_t protocol, uint16_t length, uint8_t *payload);
+
+  //send a payload made of pieces of other buffers.  The frame header
+  //is put on the front of the chain and the driver gathers the pieces
+  //as it transmits; nothing is copied into the send buffer here
+  bool sendFrame(const uint8_t *destinationMAC, 
+		 uint16_t protocol, BufferChain *payload);
   bool processFrame();
+
+  //receive and handle up to budget frames, then run the timers once.
+  //Frames the driver throws away (damaged, or dropped by an impaired
+  //link) don't count against the budget and don't end the burst.
+  //Returns the number of frames handled; if pending isn't NULL it is
+  //set to the number of frames still waiting on the driver, as far as
+  //the driver can tell (see EthernetDriver::getPendingFrames; drivers
+  //that can't always report 0)
+  uint8_t processFrames(uint8_t budget, uint8_t* pending = NULL);
   Buffer* getSendPayloadBuffer();
 
   bool registerProtocol(uint16_t etherType, PayloadHandler *handler);
+
+  //have the driver turn away frames none of the registered handlers
+  //want: unicasts to us are taken, and broadcasts if a handler asks
+  //for them.  The controller matches just one pattern, so if several
+  //handlers want broadcasts all of them are taken; ARP always wants
+  //some, so a UDP listener registered for broadcasts opens the filter
+  //to every broadcast.  extra adds other
+  //RECEIVE_ filters (with hashTable for RECEIVE_HASH).  Call it again
+  //once the handlers change.  False if the driver can't filter
+  bool setReceiveFilter(uint8_t extra = 0, const uint8_t *hashTable = NULL);
   uint8_t registerTimer(TimerHandler *handler, uint16_t millisDelay);
   void unregisterTimer(uint8_t index);
 
+  //milliseconds until the next registered timer is due (0 if one is
+  //already due, 0xFFFFFFFF if none are registered, which a caller
+  //must check for rather than wait that long).  With a SimulatedClock
+  //a driver loop can advance straight to this point
+  uint32_t getMillisToNextTimer();
+
   uint8_t *getMACAddress();
 
+  //record all frames sent and received into the capture
+  //(or stop recording by passing NULL)
+  void setCapture(FrameCapture *capture);
+  FrameCapture* getCapture();
+
   //the number of octects the EtherNet controller is capable of receiving
   //for higher level protocols.  This excludes the size of the eth header
   uint16_t getMaxReceivePayload();
@@ -8,3 +8,51 @@ EthernetDriver::EthernetDriver(uint8_t* mac){
 uint8_t* EthernetDriver::getMACAddr(){
   return this->macAddr;
 }
+
+void EthernetDriver::sendGatheredFrame(Buffer* frame, uint16_t len){
+  Buffer* sendBuffer = getSendBuffer();
+  if (frame != sendBuffer && !frame->copyTo(sendBuffer,0,0,len)) return;
+  sendFrame(len);
+}
+
+uint8_t EthernetDriver::getPendingFrames(){
+  return 0;
+}
+
+bool EthernetDriver::checksum(uint16_t address, uint16_t len, uint16_t* out){
+  return false;
+}
+
+bool EthernetDriver::setReceiveFilter(const receiveFilter* filter){
+  return false;
+}
+
+bool EthernetDriver::addToPattern(receivePattern* pattern, uint8_t offset,
+				  const uint8_t* bytes, uint8_t len){
+  for(uint8_t i=0; i<len; i++){
+    if (pattern->length >= RECEIVE_PATTERN_BYTES) return false;
+    pattern->offset[pattern->length] = offset + i;
+    pattern->value[pattern->length] = bytes[i];
+    pattern->length++;
+  }
+  return true;
+}
+
+//the CRC register as the MAC keeps it: most significant bit first, fed
+//each byte least significant bit first, as the bits go on the wire
+uint8_t EthernetDriver::hashAddress(const uint8_t* mac){
+  uint32_t crc = 0xFFFFFFFF;
+  for(uint8_t i=0; i<6; i++){
+    for(uint8_t bit=0; bit<8; bit++){
+      bool feedback = ((crc >> 31) ^ (mac[i] >> bit)) & 1;
+      crc <<= 1;
+      if (feedback) crc ^= 0x04C11DB7UL;
+    }
+  }
+  return (crc >> 23) & 0x3F;
+}
+
+void EthernetDriver::addToHashTable(uint8_t* hashTable, const uint8_t* mac){
+  uint8_t bit = hashAddress(mac);
+  hashTable[bit >> 3] |= 1 << (bit & 7);
+}
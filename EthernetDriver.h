@@ -5,12 +5,64 @@
  *  getStashBuffer is used to access a Buffer of unused available memory
  *  on the ethernet device.  If there is no excess memory, this function
  *  may return NULL.
+ *
+ *  sendGatheredFrame sends a frame whose bytes are spread over several
+ *  buffers (usually a BufferChain of headers in the send buffer and a
+ *  payload held somewhere else).  By default the pieces are copied into
+ *  the send buffer, skipping any that are already there, and the frame
+ *  is sent with sendFrame.  A driver that can gather more cheaply than
+ *  that may override it.
+ *
+ *  checksum lets a controller that can checksum its own memory do so,
+ *  so the bytes need not be read out just to be summed.  By default
+ *  there is no such support and buffers sum the bytes themselves.
+ *
+ *  setReceiveFilter lets a controller that can filter frames as they
+ *  come off the wire turn away the ones the stack has no use for, so
+ *  they never cost a read.  A frame is received if it passes any of
+ *  the filters asked for:
+ *
+ *    RECEIVE_UNICAST    frames sent to our MAC
+ *    RECEIVE_BROADCAST  every broadcast
+ *    RECEIVE_MULTICAST  every multicast, broadcasts included
+ *    RECEIVE_HASH       frames whose destination hashes to a bit set in
+ *                       the hash table (see addToHashTable)
+ *    RECEIVE_PATTERN    frames holding the bytes of the pattern
+ *    RECEIVE_MAGIC      wake-on-LAN magic packets for our MAC
+ *
+ *  A filter is a hint: a driver may let more through than was asked
+ *  for (a pattern too long for it is shortened, say), so the stack
+ *  still checks every frame.  By default there is no filtering at all
+ *  and every frame is delivered.  EtherControl::setReceiveFilter works
+ *  out a filter from the handlers registered with it.
  */
 #ifndef ETHERNET_DRIVER_H
 #define ETHERNET_DRIVER_H
 
 #include <stdint.h>
 #include <Buffer.h>
+
+#define RECEIVE_UNICAST       0x01
+#define RECEIVE_BROADCAST     0x02
+#define RECEIVE_MULTICAST     0x04
+#define RECEIVE_HASH          0x08
+#define RECEIVE_PATTERN       0x10
+#define RECEIVE_MAGIC         0x20
+
+#define RECEIVE_PATTERN_BYTES 16
+
+//bytes a frame must hold, each at an offset from the start of the frame
+typedef struct receivePattern {
+  uint8_t length;
+  uint8_t offset[RECEIVE_PATTERN_BYTES];
+  uint8_t value[RECEIVE_PATTERN_BYTES];
+} receivePattern;
+
+typedef struct receiveFilter {
+  uint8_t accept;               //the RECEIVE_ filters a frame may pass
+  uint8_t hashTable[8];         //for RECEIVE_HASH
+  receivePattern pattern;       //for RECEIVE_PATTERN
+} receiveFilter;
     
 class EthernetDriver {
 
@@ -27,8 +79,34 @@ public:
   virtual Buffer* getStashBuffer() = 0;
 
   virtual void sendFrame (uint16_t len) = 0;
+  virtual void sendGatheredFrame (Buffer* frame, uint16_t len);
   virtual uint16_t receiveFrame() = 0;
 
+  //the number of received frames waiting to be collected with
+  //receiveFrame.  0, the default, if there are none or the driver
+  //can't tell
+  virtual uint8_t getPendingFrames();
+
+  //the internet checksum (as written to a packet) of len bytes of the
+  //controller's memory starting at address.  False, the default, if
+  //the controller can't do it right now
+  virtual bool checksum(uint16_t address, uint16_t len, uint16_t* out);
+
+  //have the controller filter received frames.  False, the default, if
+  //it can't, in which case every frame is still delivered
+  virtual bool setReceiveFilter(const receiveFilter* filter);
+
+  //add len bytes to pattern at offset; false if there isn't room for
+  //them all (the pattern then matches more frames, never fewer)
+  static bool addToPattern(receivePattern* pattern, uint8_t offset,
+			   const uint8_t* bytes, uint8_t len);
+
+  //set the hash table bit for mac: bits 28:23 of the CRC-32 of the
+  //address, as the ENC28J60 (and most other controllers) pick it.
+  //01:00:5E:00:00:FB (mDNS) hashes to 62, 33:33:00:00:00:01 to 51
+  static uint8_t hashAddress(const uint8_t* mac);
+  static void addToHashTable(uint8_t* hashTable, const uint8_t* mac);
+
   virtual bool isLinkUp () = 0;
   virtual void powerDown() = 0;
   virtual void powerUp() = 0;
@@ -0,0 +1,108 @@
+/*
+ * An in-memory ring of captured ethernet frames that can be written
+ * out as a libpcap stream.  See FrameCapture.h for usage.
+ */
+
+#include <stdlib.h>
+#include <hostutil.h>
+#include "Pcap.h"
+#include "FrameCapture.h"
+
+//entries are padded to keep each captureEntry 4 byte aligned
+#define ENTRY_SIZE ((sizeof(captureEntry) + snapLen + 3) & ~3)
+
+/* ======================================================================= */
+/*                            I N I T I A L I Z E                          */
+/* ======================================================================= */
+FrameCapture::FrameCapture(uint8_t capacity, uint16_t snapLen){
+  this->snapLen = snapLen;
+  this->ring = (uint8_t*)malloc((uint32_t)capacity * ENTRY_SIZE);
+  if (this->ring == NULL){
+    this->capacity = 0;
+#ifdef DEBUG
+    fprintf(stderr,"Out of memory allocating FrameCapture ring\n");
+#endif
+  }
+  else
+    this->capacity = capacity;
+
+  clear();
+}
+
+FrameCapture::~FrameCapture(){
+  free(this->ring);
+}
+
+captureEntry* FrameCapture::getEntry(uint8_t index){
+  return (captureEntry*)(ring + (uint32_t)index * ENTRY_SIZE);
+}
+
+/* ======================================================================= */
+/*                              C A P T U R E                              */
+/* ======================================================================= */
+void FrameCapture::record(Buffer* frame, uint16_t len){
+  if (capacity == 0) return;
+
+  captureEntry* entry = getEntry(head);
+  uint16_t capLen = len < snapLen ? len : snapLen;
+
+  if (!frame->read(0,(uint8_t*)(entry+1),capLen))
+    return;
+
+  entry->time = host_millis();
+  entry->origLen = len;
+  entry->capLen = capLen;
+
+  head = (head + 1) % capacity;
+  if (count < capacity) count++;
+  framesCaptured++;
+}
+
+void FrameCapture::clear(){
+  head = 0;
+  count = 0;
+  framesCaptured = 0;
+}
+
+/* ======================================================================= */
+/*                                  D U M P                                */
+/* ======================================================================= */
+bool FrameCapture::dump(FILE* out){
+
+  pcapFileHeader header;
+  header.magic = PCAP_MAGIC;
+  header.versionMajor = PCAP_VERSION_MAJOR;
+  header.versionMinor = PCAP_VERSION_MINOR;
+  header.thisZone = 0;
+  header.sigFigs = 0;
+  header.snapLen = snapLen;
+  header.linkType = PCAP_LINKTYPE_ETHERNET;
+  if (fwrite(&header,sizeof(header),1,out) != 1) return false;
+
+  //the oldest entry is count entries behind the head
+  uint8_t index = (head + capacity - count) % (capacity == 0 ? 1 : capacity);
+
+  for(uint8_t i=0; i<count; i++){
+    captureEntry* entry = getEntry(index);
+
+    pcapRecordHeader record;
+    record.tsSec = entry->time / 1000;
+    record.tsFrac = (entry->time % 1000) * 1000;
+    record.inclLen = entry->capLen;
+    record.origLen = entry->origLen;
+    if (fwrite(&record,sizeof(record),1,out) != 1) return false;
+    if (fwrite(entry+1,1,entry->capLen,out) != entry->capLen) return false;
+
+    index = (index + 1) % capacity;
+  }
+
+  fflush(out);
+  return true;
+}
+
+/* ======================================================================= */
+/*                                A C C E S S O R S                        */
+/* ======================================================================= */
+uint8_t FrameCapture::getCount(){ return count; }
+uint16_t FrameCapture::getSnapLen(){ return snapLen; }
+uint32_t FrameCapture::getFramesCaptured(){ return framesCaptured; }
@@ -0,0 +1,64 @@
+/*
+ *  A FrameCapture records ethernet frames into a fixed-size ring in
+ *  memory so that traffic can be traced without disturbing the timing
+ *  of the application.  Recording a frame costs a single Buffer read of
+ *  at most snapLen bytes; nothing is formatted or printed until dump()
+ *  is called.
+ *
+ *  Attach a capture to an EtherControl to record every frame sent and
+ *  received:
+ *
+ *      FrameCapture* capture = new FrameCapture(16,64);
+ *      control->setCapture(capture);
+ *      ...
+ *      capture->dump(stdout);   //writes a libpcap stream
+ *
+ *  Once the ring is full the oldest frames are overwritten.  The dump
+ *  lists the frames oldest first and can be opened with wireshark or
+ *  tcpdump -r.  Timestamps come from host_millis().
+ */
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <Buffer.h>
+
+typedef struct captureEntry {
+  uint32_t time;     //host_millis() at the time of capture
+  uint16_t origLen;  //length of the frame
+  uint16_t capLen;   //bytes of the frame that were kept
+} captureEntry;
+
+class FrameCapture {
+
+  uint8_t* ring;
+  uint8_t capacity;
+  uint16_t snapLen;
+  uint8_t head;   //the next entry to be written
+  uint8_t count;  //the number of valid entries
+  uint32_t framesCaptured;
+
+  captureEntry* getEntry(uint8_t index);
+
+ public:
+  FrameCapture(uint8_t capacity, uint16_t snapLen = 64);
+  ~FrameCapture();
+
+  //record the first snapLen bytes of a len byte frame
+  void record(Buffer* frame, uint16_t len);
+
+  //write the ring, oldest frame first, as a libpcap stream
+  bool dump(FILE* out);
+
+  void clear();
+
+  uint8_t getCount();
+  uint16_t getSnapLen();
+
+  //total frames recorded since the last clear(), including those
+  //that have since been overwritten
+  uint32_t getFramesCaptured();
+};
+
+#endif
@@ -0,0 +1,218 @@
+/*
+ *  Compile time descriptions of the protocol headers, so a header can be
+ *  put together (or taken apart) in memory and cross the Buffer in a
+ *  single write() (or read()).
+ *
+ *  Each layout names its fields; a field knows its offset, its size and
+ *  its byte order, all at compile time, so setting one is a couple of
+ *  plain stores:
+ *
+ *     Header<UDPHeader> udp;
+ *     udp.place(datagram);                   //in place, or on the stack
+ *     udp.set<UDPHeader::SourcePort>(sport);
+ *     udp.set<UDPHeader::DestinationPort>(dport);
+ *     ...
+ *     if (!udp.store(datagram)) return false; //one write, if any at all
+ *
+ *  and reading one back is the mirror image:
+ *
+ *     Header<UDPHeader> udp;
+ *     if (!udp.load(datagram)) return;       //one read, if any at all
+ *     uint16_t dport = udp.get<UDPHeader::DestinationPort>();
+ *
+ *  A field that does not fit inside the header it is used with will not
+ *  compile.  Fields of several bytes (addresses) read back as a pointer
+ *  into the header and are copied in when set.
+ *
+ *  Only integral constants and templates are used, so the descriptions
+ *  cost nothing at run time on compilers without constexpr.
+ */
+#ifndef HEADERS_H
+#define HEADERS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <Buffer.h>
+
+/* ==================================================================== */
+/*                            F I E L D S                               */
+/* ==================================================================== */
+template <uint8_t Offset> struct Net8 {
+  typedef uint8_t type;
+  enum { offset = Offset, size = 1 };
+  static inline uint8_t get(const uint8_t* h){ return h[Offset]; }
+  static inline void set(uint8_t* h, uint8_t d){ h[Offset] = d; }
+};
+
+template <uint8_t Offset> struct Net16 {
+  typedef uint16_t type;
+  enum { offset = Offset, size = 2 };
+  static inline uint16_t get(const uint8_t* h){
+    return Buffer::getNet16(h+Offset);
+  }
+  static inline void set(uint8_t* h, uint16_t d){
+    Buffer::putNet16(h+Offset,d);
+  }
+};
+
+template <uint8_t Offset> struct Net32 {
+  typedef uint32_t type;
+  enum { offset = Offset, size = 4 };
+  static inline uint32_t get(const uint8_t* h){
+    return Buffer::getNet32(h+Offset);
+  }
+  static inline void set(uint8_t* h, uint32_t d){
+    Buffer::putNet32(h+Offset,d);
+  }
+};
+
+//Size bytes copied as they are (MAC and IP addresses)
+template <uint8_t Offset, uint8_t Size> struct Bytes {
+  typedef const uint8_t* type;
+  enum { offset = Offset, size = Size };
+  static inline const uint8_t* get(const uint8_t* h){ return h+Offset; }
+  static inline void set(uint8_t* h, const uint8_t* d){
+    memcpy(h+Offset,d,Size);
+  }
+};
+
+/* ==================================================================== */
+/*                           L A Y O U T S                              */
+/* ==================================================================== */
+struct EthernetHeader {
+  enum { LENGTH = 14 };
+  typedef Bytes<0,6>  Destination;
+  typedef Bytes<6,6>  Source;
+  typedef Net16<12>   Protocol;
+};
+
+//an ARP packet for IPv4 over ethernet
+struct ARPHeader {
+  enum { LENGTH = 28 };
+  typedef Net16<0>    HardwareType;
+  typedef Net16<2>    ProtocolType;
+  typedef Net8<4>     HardwareLength;
+  typedef Net8<5>     ProtocolLength;
+  typedef Net16<6>    Operation;
+  typedef Bytes<8,6>  SenderMAC;
+  typedef Bytes<14,4> SenderIP;
+  typedef Bytes<18,6> TargetMAC;
+  typedef Bytes<24,4> TargetIP;
+};
+
+//an IPv4 header without options
+struct IPHeader {
+  enum { LENGTH = 20 };
+  typedef Net8<0>     VersionLength;
+  typedef Net8<1>     TypeOfService;
+  typedef Net16<2>    TotalLength;
+  typedef Net16<4>    Identification;
+  typedef Net16<6>    Fragment;     //flags and fragment offset
+  typedef Net8<8>     TTL;
+  typedef Net8<9>     Protocol;
+  typedef Net16<10>   Checksum;
+  typedef Bytes<12,4> Source;
+  typedef Bytes<16,4> Destination;
+};
+
+struct UDPHeader {
+  enum { LENGTH = 8 };
+  typedef Net16<0>    SourcePort;
+  typedef Net16<2>    DestinationPort;
+  typedef Net16<4>    Length;
+  typedef Net16<6>    Checksum;
+};
+
+//a TCP header, room included for the one option we send (MSS)
+struct TCPHeader {
+  enum { LENGTH = 20, MSS_LENGTH = 24 };
+  typedef Net16<0>    SourcePort;
+  typedef Net16<2>    DestinationPort;
+  typedef Net32<4>    Sequence;
+  typedef Net32<8>    Acknowledgement;
+  typedef Net8<12>    DataOffset;   //header length in words, high nibble
+  typedef Net8<13>    Control;      //the flags
+  typedef Net16<12>   OffsetControl;//both of the above
+  typedef Net16<14>   Window;
+  typedef Net16<16>   Checksum;
+  typedef Net16<18>   Urgent;
+  typedef Net8<20>    OptionKind;
+  typedef Net8<21>    OptionLength;
+  typedef Net16<22>   MaxSegmentSize;
+};
+
+struct DNSHeader {
+  enum { LENGTH = 12 };
+  typedef Net16<0>    ID;
+  typedef Net16<2>    Control;
+  typedef Net16<4>    QuestionCount;
+  typedef Net16<6>    AnswerCount;
+  typedef Net16<8>    AuthorityCount;
+  typedef Net16<10>   AdditionalCount;
+};
+
+/* ==================================================================== */
+/*                            H E A D E R                               */
+/* ==================================================================== */
+/*
+ * Length bytes of a Layout header.  The bytes are the buffer's own when
+ * it keeps them in memory (see Buffer::span), otherwise a copy held here.
+ * Length may be given when a header is longer than Layout::LENGTH (TCP
+ * with options).
+ */
+template <class Layout, uint8_t Length = Layout::LENGTH>
+class Header {
+
+  uint8_t image[Length];
+  uint8_t* bytes;
+
+  //fails to compile when a field runs past the end of the header
+  template <class Field> struct fits {
+    typedef char check[(Field::offset + Field::size <= Length) ? 1 : -1];
+  };
+
+  Header(const Header&);
+  Header& operator=(const Header&);
+
+ public:
+  Header(){ bytes = image; }
+
+  //build the header at offset in buffer.  Nothing is written to the
+  //buffer until store() unless the buffer is in memory
+  void place(Buffer* buffer, uint16_t offset = 0){
+    bytes = buffer->span(offset,Length);
+    if (bytes == NULL) bytes = image;
+  }
+
+  //put the header in the buffer as place() left it; len for a header
+  //shorter than Length.  False if the write fails
+  bool store(Buffer* buffer, uint16_t offset = 0, uint16_t len = Length){
+    return bytes != image || buffer->write(offset,bytes,len);
+  }
+
+  //the header at offset in buffer, read in one go when it is not in
+  //memory.  False if the buffer is too small
+  bool load(Buffer* buffer, uint16_t offset = 0){
+    bytes = buffer->load(offset,Length,image);
+    if (bytes != NULL) return true;
+    bytes = image;
+    return false;
+  }
+
+  //true when the bytes are the buffer's own and store() has nothing to do
+  bool inPlace(){ return bytes != image; }
+
+  uint8_t* data(){ return bytes; }
+
+  template <class Field> typename Field::type get(){
+    (void)sizeof(typename fits<Field>::check);
+    return Field::get(bytes);
+  }
+
+  template <class Field> void set(typename Field::type d){
+    (void)sizeof(typename fits<Field>::check);
+    Field::set(bytes,d);
+  }
+};
+
+#endif
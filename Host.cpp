@@ -3,16 +3,28 @@
  * from host to host.  For the sake of writing code that can easily
  * be ported from one to another host, these host dependent implementations
  * have been consolidated here.
+ *
+ * Two hosts are currently supported:
+ *   - Arduino/atmega (any build where ARDUINO is defined)
+ *   - POSIX (Linux and friends), which allows the protocol stack to be
+ *     built and run on a workstation; see TapDriver for a matching
+ *     EthernetDriver
  */
 
 #include "hostutil.h"
 #include "Host.h"
 
+#if defined(ARDUINO)
 #if ARDUINO >= 100
 #include <Arduino.h> // Arduino 1.0
 #else
 #include <Wprogram.h> // Arduino 0022
 #endif
+#else
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#endif
 
 //make these functions available in pure c
 void hostinit() { Host::init(); }
@@ -28,11 +40,43 @@ uint16_t Host::ntohs (uint16_t value){ return NTOHS(value); }
 uint32_t Host::htonl (uint32_t value){ return HTONL(value); }
 uint32_t Host::ntohl (uint32_t value){ return NTOHL(value); }
 
-//return the Arduino version of millis
+//when set, time comes from here rather than from the platform
+static ClockSource* clockSource = NULL;
+static uint32_t platformMillis();
+
+//set once the application has chosen its own seed so that
+//init() does not replace it with a random one
+static bool randomSeeded = false;
+
 uint32_t Host::getMillis(){
+  if (clockSource != NULL)
+    return clockSource->getMillis();
+  return platformMillis();
+}
+
+void Host::setClockSource(ClockSource* clock){
+  clockSource = clock;
+}
+
+ClockSource* Host::getClockSource(){
+  return clockSource;
+}
+
+#if defined(ARDUINO)
+/* ========================================================================= */
+/*                              A R D U I N O                                */
+/* ========================================================================= */
+
+//return the Arduino version of millis
+static uint32_t platformMillis(){
   return millis();
 }
 
+void Host::setRandomSeed(uint32_t seed){
+  randomSeed(seed);
+  randomSeeded = true;
+}
+
 int put_serial(char c, FILE *t){
   if (t != stdout && t!= stderr) return EOF;
   Serial.print(c);
@@ -47,13 +91,61 @@ void Host::init(){
   fdevopen(&put_serial, NULL);
 
   //seed the RNG with some random values read from analog pin 3
-  for(uint16_t i=0; i<1000; i++){
+  for(uint16_t i=0; i<1000 && !randomSeeded; i++){
     word val = analogRead(3);
     if (val > 100 && val < 1000){
       randomSeed(val);
       break;
     }
   }
-  
+
   initialized = true;
 }
+
+#else
+/* ========================================================================= */
+/*                                P O S I X                                  */
+/* ========================================================================= */
+
+//milliseconds on the monotonic clock since the first call.  Like the
+//Arduino millis() this starts near zero and wraps after ~49 days, so
+//all of the elapsed time arithmetic in the stack behaves the same way
+static uint32_t platformMillis(){
+  static bool started = false;
+  static struct timespec start;
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (!started){
+    start = now;
+    started = true;
+  }
+
+  return (uint32_t)((now.tv_sec - start.tv_sec) * 1000 +
+		    (now.tv_nsec - start.tv_nsec) / 1000000);
+}
+
+void Host::setRandomSeed(uint32_t seed){
+  srandom(seed);
+  randomSeeded = true;
+}
+
+void Host::init(){
+  static bool initialized = false;
+  if (initialized) return;
+
+  //stdout and stderr are already usable; just seed the RNG
+  //that is used for port numbers and initial sequence numbers
+  if (!randomSeeded){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    srandom((unsigned int)(now.tv_nsec ^ now.tv_sec ^ getpid()));
+  }
+
+  //start the millisecond clock
+  platformMillis();
+
+  initialized = true;
+}
+
+#endif
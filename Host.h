@@ -10,10 +10,16 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <ClockSource.h>
 
-#define HTONS(s) (s >> 8 | s << 8)
+//the casts keep the macros correct on hosts where int is wider than
+//16 bits (on the AVR the shifted bits simply fall off the end of an int)
+#define HTONS(s) ((uint16_t)((uint16_t)(s) >> 8 | (uint16_t)(s) << 8))
 #define NTOHS(s) HTONS(s)
-#define HTONL(w) (w>>24|w<<8>>24<<8|w>>8<<24>>8|w<<24)
+#define HTONL(w) ((uint32_t)((uint32_t)(w)>>24 | \
+			     (uint32_t)(w)<<8>>24<<8 | \
+			     (uint32_t)(w)>>8<<24>>8 | \
+			     (uint32_t)(w)<<24))
 #define NTOHL(w) HTONL(w)
 
 class Host {
@@ -27,6 +33,15 @@ class Host {
   static uint32_t ntohl (uint32_t value);
   
   static uint32_t getMillis();
+
+  //replace the platform clock used by getMillis() (and host_millis());
+  //pass NULL to return to the platform clock
+  static void setClockSource(ClockSource* clock);
+  static ClockSource* getClockSource();
+
+  //reseed the random number generator used for ports and sequence
+  //numbers, e.g. to make a simulated run repeatable
+  static void setRandomSeed(uint32_t seed);
 };
 
 #endif
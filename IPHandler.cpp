@@ -26,6 +26,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <Headers.h>
 #include "IPHandler.h"
 
 /* ========================================================================= */
@@ -177,15 +178,18 @@ Buffer* IPHandler::getSendPayloadBuffer(){
   return sendPacketBuffer;
 }//end getPacketpayloadBuffer
 
-bool IPHandler::sendPacket(uint8_t *destinationIP, uint8_t protocol,
-		    uint16_t packetPayloadLength){
+//write the IP header to the send buffer and return the MAC address
+//the packet should go to, or NULL if it cannot be sent
+const uint8_t* IPHandler::writeHeader(uint8_t *destinationIP, 
+				      uint8_t protocol,
+				      uint16_t packetPayloadLength){
   //get the transmit buffer and make sure we have enough room
   Buffer *p = etherControl->getSendPayloadBuffer();
   if (p->size() < IP_HEADER_LENGTH + packetPayloadLength){
 #ifdef DEBUG
     fprintf(stderr,"Err: buffer not large enough for IP packet.\n");
 #endif
-    return false;
+    return NULL;
   }
 
   //make sure we have a route to our destination IP
@@ -195,27 +199,61 @@ bool IPHandler::sendPacket(uint8_t *destinationIP, uint8_t protocol,
 #ifdef DEBUG
     fprintf(stderr,"Err: No route to host. Failed sending IP packet.\n");
 #endif
-    return false;
+    return NULL;
   }
 
-  //populate the IP packet header
-  p->write8(0,0x45); //IPv4, 5 32-bit uint16_ts in header
-  p->write8(1,0x00);  //dscp and enc = 0
-  p->writeNet16(2,packetPayloadLength + IP_HEADER_LENGTH); //ip frame length
-  p->writeNet16(4,0); //identification
-  p->writeNet16(6,0x4000); //flags and fragment offset
-  p->write8(8,64); // set ttl to 64
-  p->write8(9,protocol); //protocol
-  p->write(12,this->ipAddress,4);
-  p->write(16,destinationIP,4);
+  //populate the IP packet header.  It is assembled in place when the
+  //send buffer is in memory, otherwise on the stack and written in one
+  //go; either way the checksum is taken without reading it back
+  uint16_t totalLength = packetPayloadLength + IP_HEADER_LENGTH;
+  Header<IPHeader> ip;
+  ip.place(p);
+  ip.set<IPHeader::VersionLength>(0x45); //IPv4, 5 32-bit words in header
+  ip.set<IPHeader::TypeOfService>(0x00); //dscp and enc = 0
+  ip.set<IPHeader::TotalLength>(totalLength); //ip frame length
+  ip.set<IPHeader::Identification>(0);
+  ip.set<IPHeader::Fragment>(0x4000); //don't fragment
+  ip.set<IPHeader::TTL>(64);
+  ip.set<IPHeader::Protocol>(protocol);
+  ip.set<IPHeader::Checksum>(0);
+  ip.set<IPHeader::Source>(this->ipAddress);
+  ip.set<IPHeader::Destination>(destinationIP);
 
   //calculate the header checksum
-  p->writeNet16(10,p->checksum(IP_HEADER_LENGTH,10));
+  uint32_t sum = Buffer::sumWords(ip.data(),IP_HEADER_LENGTH);
+  while (sum >> 16)
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  ip.set<IPHeader::Checksum>(~sum);
+
+  if (!ip.store(p)) return NULL;
+
+  return macAddr;
+}
+
+bool IPHandler::sendPacket(uint8_t *destinationIP, uint8_t protocol,
+			   uint16_t packetPayloadLength){
+  const uint8_t* macAddr = 
+    writeHeader(destinationIP,protocol,packetPayloadLength);
+  if (macAddr == NULL) return false;
 
   return etherControl->sendFrame(macAddr,IP_PROTOCOL,
 				 packetPayloadLength + IP_HEADER_LENGTH);
 }
 
+bool IPHandler::sendPacket(uint8_t *destinationIP, uint8_t protocol,
+			   BufferChain *payload){
+  const uint8_t* macAddr = 
+    writeHeader(destinationIP,protocol,payload->size());
+  if (macAddr == NULL) return false;
+
+  //our header, then the payload from wherever it is
+  if (!payload->prepend(etherControl->getSendPayloadBuffer(),0,
+			IP_HEADER_LENGTH)) 
+    return false;
+
+  return etherControl->sendFrame(macAddr,IP_PROTOCOL,payload);
+}
+
 bool IPHandler::sendPacket(uint8_t *destinationIP, uint8_t protocol,
 			   uint16_t packetPayloadLength, uint8_t *payload){
 
@@ -243,44 +281,58 @@ void IPHandler::handlePayload(Buffer *p){
   if (p->size() < IP_HEADER_LENGTH)
       return;
 
+  //parse the header with plain loads from here on
+  Header<IPHeader> ip;
+  if (!ip.load(p)) return;
+
   //verify checksum of the IP header
-  uint16_t checksum = 0;
-  if (!p->readNet16(10,&checksum)) return;
-  if (checksum != p->checksum(IP_HEADER_LENGTH,10)){
+  uint8_t* header = ip.data();
+  uint32_t sum = Buffer::sumWords(header,IPHeader::Checksum::offset);
+  sum = Buffer::sumWords(header+IPHeader::Source::offset,
+			 IP_HEADER_LENGTH-IPHeader::Source::offset,sum);
+  while (sum >> 16)
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  if (ip.get<IPHeader::Checksum>() != (uint16_t)~sum){
     return; //bad checksum; data corrupted in transit so discard
   }
 
   //the size of the packet should equal the size of the payload (or less))
   //If not, discard the packet because something is wrong
-  uint16_t len = 0;
-  if (!p->readNet16(2,&len)) return;
+  uint16_t len = ip.get<IPHeader::TotalLength>();
   if (p->size() < len) return;
 
   //we should only care about packet sent to our IP 
   //or packets sent to our broadcast address
-  uint8_t ip[4];
-  if (!p->read(16,ip,4)) return; //load the destination ip
-  if (!ipsEquate(ip,ipAddress) &&
-      !ipsEquate(ip,ipBroadcastAddress))
+  uint8_t* destination = (uint8_t*)ip.get<IPHeader::Destination>();
+  if (!ipsEquate(destination,ipAddress) &&
+      !ipsEquate(destination,ipBroadcastAddress))
     return;
 
   //determine our protocol and call our protocol handler
-  uint8_t protocol;
-  if (!p->read8(9,&protocol)) return;
-  PacketHandler *handler = getProtocolHandler(protocol);
+  PacketHandler *handler = getProtocolHandler(ip.get<IPHeader::Protocol>());
 
   if (handler != NULL){
     OffsetBuffer ipPacketBuffer = 
       OffsetBuffer(p,IP_HEADER_LENGTH,len - IP_HEADER_LENGTH);
     
-    //load the source ip
-    if (!p->read(12,ip,4)) return;
+    //the source ip; copied, as the handler is free to reuse the buffer
+    uint8_t sourceIP[4];
+    memcpy(sourceIP,ip.get<IPHeader::Source>(),4);
 
-    handler->handlePacket(ip,&ipPacketBuffer);
+    handler->handlePacket(sourceIP,&ipPacketBuffer);
   }
   
 }//end handlePayload
 
+bool IPHandler::matchBroadcasts(receivePattern*){
+  for(uint8_t i=0; i<sizeof(protocolRegistry) / sizeof(ipProtocolMap);i++){
+    if (protocolRegistry[i].handler != NULL &&
+	protocolRegistry[i].handler->wantsBroadcasts())
+      return true;
+  }//end for
+  return false;
+}//end matchBroadcasts
+
 ARPHandler* IPHandler::getARPHandler(){
   return this->arp;
 }
@@ -15,6 +15,10 @@ class PacketHandler {
  public:
   virtual void handlePacket(uint8_t *sourceIP, Buffer *packet) = 0;
 
+  //whether packets of this protocol sent to our broadcast address are
+  //wanted (see IPHandler::matchBroadcasts).  By default they are
+  virtual bool wantsBroadcasts(){ return true; }
+
 };
 
 typedef struct ipProtocolMap {
@@ -44,6 +48,9 @@ class IPHandler: PayloadHandler{
 
   OffsetBuffer *sendPacketBuffer;
 
+  const uint8_t* writeHeader(uint8_t *destinationIP, uint8_t protocol,
+			     uint16_t packetPayloadLength);
+
  public:
   IPHandler(uint8_t *ipAddress, uint8_t *gatewayIP, uint8_t *subnetMask,
 	    ARPHandler *arp, EtherControl *control); 
@@ -64,9 +71,19 @@ class IPHandler: PayloadHandler{
   
   bool sendPacket(uint8_t *destinationIP,uint8_t protocol,
 		  uint16_t packetPayloadLength,uint8_t *payload);
+
+  //send a payload made of pieces of other buffers.  Our header goes on
+  //the front of the chain; the pieces are gathered, not copied
+  bool sendPacket(uint8_t *destinationIP,uint8_t protocol,
+		  BufferChain *payload);
   
   void handlePayload(Buffer *p);
 
+  //every IP broadcast, if a protocol handler wants any.  ARP takes
+  //broadcasts as well and the controller matches only one pattern, so
+  //narrowing ours would never reach it
+  bool matchBroadcasts(receivePattern *pattern);
+
   ARPHandler* getARPHandler();
   
   const uint8_t* getMACForIP(uint8_t *destinationIP);
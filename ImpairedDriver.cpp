@@ -0,0 +1,324 @@
+/*
+ * This is an EthernetDriver that impairs the link of another driver.
+ * See ImpairedDriver.h for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ImpairedDriver.h"
+#include "hostutil.h"
+
+/* ======================================================================= */
+/*                            I N I T I A L I Z E                          */
+/* ======================================================================= */
+ImpairedDriver::ImpairedDriver(EthernetDriver* inner, uint8_t slotCapacity,
+			       uint16_t maxFrameLength):
+  EthernetDriver(inner->getMACAddr()){
+
+  this->inner = inner;
+
+  memset(config,0,sizeof(config));
+  resetStats();
+  busyUntil[IMPAIR_TX] = busyUntil[IMPAIR_RX] = 0;
+  busyResidue[IMPAIR_TX] = busyResidue[IMPAIR_RX] = 0;
+  held[IMPAIR_TX] = held[IMPAIR_RX] = 0;
+  sequence = 0;
+
+  //the frames we hand to the EtherControl live in our own memory so
+  //that releasing a held frame never disturbs one being assembled
+  this->sendData = (uint8_t*)malloc(maxFrameLength);
+  this->recvData = (uint8_t*)malloc(maxFrameLength);
+  if (sendData == NULL || recvData == NULL){
+    maxFrameLength = 0;
+#ifdef DEBUG
+    fprintf(stderr,"Out of memory allocating frames in ImpairedDriver\n");
+#endif
+  }
+  this->maxFrameLength = maxFrameLength;
+  this->sendBuffer = new MemBuffer(maxFrameLength,sendData);
+  this->recvBuffer = new MemBuffer(maxFrameLength,recvData);
+
+  this->slots = (impairedSlot*)malloc(sizeof(impairedSlot)*slotCapacity);
+  uint8_t* slotData = (uint8_t*)malloc((uint32_t)slotCapacity*maxFrameLength);
+  if (slots == NULL || slotData == NULL){
+    free(slotData);
+    slotCapacity = 0;
+#ifdef DEBUG
+    fprintf(stderr,"Out of memory allocating slots in ImpairedDriver\n");
+#endif
+  }
+  this->slotCapacity = slotCapacity;
+
+  for(uint8_t i=0; i<slotCapacity; i++){
+    slots[i].used = false;
+    slots[i].data = slotData + (uint32_t)i*maxFrameLength;
+  }
+}
+
+ImpairedDriver::~ImpairedDriver(){
+  if (slots != NULL && slotCapacity > 0)
+    free(slots[0].data);
+  free(slots);
+  delete sendBuffer;
+  delete recvBuffer;
+  free(sendData);
+  free(recvData);
+}
+
+EthernetDriver* ImpairedDriver::getInnerDriver(){
+  return inner;
+}
+
+/* ======================================================================= */
+/*                        C O N F I G U R A T I O N                        */
+/* ======================================================================= */
+void ImpairedDriver::setImpairment(uint8_t direction, const impairment* cfg){
+  if (direction > IMPAIR_RX) return;
+  config[direction] = *cfg;
+}
+
+impairment* ImpairedDriver::getImpairment(uint8_t direction){
+  if (direction > IMPAIR_RX) return NULL;
+  return &config[direction];
+}
+
+void ImpairedDriver::clearImpairments(){
+  memset(config,0,sizeof(config));
+  busyUntil[IMPAIR_TX] = busyUntil[IMPAIR_RX] = 0;
+  busyResidue[IMPAIR_TX] = busyResidue[IMPAIR_RX] = 0;
+
+  //make everything we are holding due now; the order is kept by the
+  //sequence numbers
+  uint32_t now = host_millis();
+  for(uint8_t i=0; i<slotCapacity; i++)
+    slots[i].releaseTime = now;
+
+  sendDue();
+}
+
+impairmentStats* ImpairedDriver::getStats(uint8_t direction){
+  if (direction > IMPAIR_RX) return NULL;
+  return &stats[direction];
+}
+
+void ImpairedDriver::resetStats(){
+  memset(stats,0,sizeof(stats));
+}
+
+uint8_t ImpairedDriver::getHeldFrames(){
+  return held[IMPAIR_TX] + held[IMPAIR_RX];
+}
+
+uint32_t ImpairedDriver::getMillisToNextRelease(){
+  uint32_t next = 0xFFFFFFFF;
+  uint32_t now = host_millis();
+  for(uint8_t i=0; i<slotCapacity; i++){
+    if (!slots[i].used) continue;
+    int32_t remaining = (int32_t)(slots[i].releaseTime - now);
+    if (remaining <= 0) return 0;
+    if ((uint32_t)remaining < next) next = remaining;
+  }
+  return next;
+}
+
+/* ======================================================================= */
+/*                         I M P A I R M E N T S                           */
+/* ======================================================================= */
+bool ImpairedDriver::chance(uint8_t pct){
+  if (pct == 0) return false;
+  return (uint8_t)(random() % 100) < pct;
+}
+
+//work out when a frame offered now should leave the link
+uint32_t ImpairedDriver::releaseTime(uint8_t direction, uint16_t len,
+				     bool reorder){
+  impairment* cfg = &config[direction];
+  uint32_t now = host_millis();
+  uint32_t time = now;
+
+  if (!reorder){
+    int32_t delay = cfg->latency;
+    if (cfg->jitter > 0)
+      delay += (int32_t)(random() % (2 * (uint32_t)cfg->jitter + 1)) -
+	cfg->jitter;
+    if (delay > 0) time += delay;
+  }
+
+  if (cfg->bandwidth > 0){
+    //the frame cannot start until the previous one has finished; if the
+    //link has been idle, any fraction of a millisecond left over is lost
+    if ((int32_t)(busyUntil[direction] - time) > 0)
+      time = busyUntil[direction];
+    else
+      busyResidue[direction] = 0;
+
+    uint32_t work = (uint32_t)len * 1000 + busyResidue[direction];
+    time += work / cfg->bandwidth;
+    busyResidue[direction] = work % cfg->bandwidth;
+    busyUntil[direction] = time;
+  }
+
+  return time;
+}
+
+void ImpairedDriver::hold(uint8_t direction, Buffer* frame, uint16_t len,
+			  uint32_t releaseTime){
+  for(uint8_t i=0; i<slotCapacity; i++){
+    if (slots[i].used) continue;
+    if (!frame->read(0,slots[i].data,len)) return;
+    slots[i].used = true;
+    slots[i].direction = direction;
+    slots[i].len = len;
+    slots[i].releaseTime = releaseTime;
+    slots[i].sequence = sequence++;
+    held[direction]++;
+    if ((int32_t)(releaseTime - host_millis()) > 0)
+      stats[direction].delayed++;
+    return;
+  }
+
+  stats[direction].overflows++;
+}
+
+//apply the impairments for a direction to a frame.  Returns true if the
+//frame should go straight through; otherwise it has been dropped or held
+bool ImpairedDriver::offer(uint8_t direction, Buffer* frame, uint16_t len){
+  impairment* cfg = &config[direction];
+  stats[direction].frames++;
+
+  if (chance(cfg->lossPct)){
+    stats[direction].lost++;
+    return false;
+  }
+
+  uint8_t copies = 1;
+  if (chance(cfg->duplicatePct)){
+    stats[direction].duplicated++;
+    copies = 2;
+  }
+
+  bool passThrough = false;
+  for(uint8_t c=0; c<copies; c++){
+    bool reorder = chance(cfg->reorderPct);
+    if (reorder) stats[direction].reordered++;
+
+    uint32_t time = releaseTime(direction,len,reorder);
+
+    //a frame that is due now may skip the slots, provided it does not
+    //overtake frames already held (unless it is meant to)
+    if (!passThrough && (int32_t)(time - host_millis()) <= 0 &&
+	(reorder || held[direction] == 0)){
+      passThrough = true;
+      continue;
+    }
+
+    hold(direction,frame,len,time);
+  }
+
+  return passThrough;
+}
+
+//the held frame for a direction that is due first, or -1 if none are due
+int16_t ImpairedDriver::nextDue(uint8_t direction){
+  if (held[direction] == 0) return -1;
+
+  int16_t next = -1;
+  uint32_t now = host_millis();
+  for(uint8_t i=0; i<slotCapacity; i++){
+    if (!slots[i].used || slots[i].direction != direction) continue;
+    if ((int32_t)(slots[i].releaseTime - now) > 0) continue;
+
+    if (next < 0){
+      next = i;
+      continue;
+    }
+
+    int32_t diff = (int32_t)(slots[i].releaseTime - slots[next].releaseTime);
+    if (diff < 0 ||
+	(diff == 0 && (int32_t)(slots[i].sequence - slots[next].sequence) < 0))
+      next = i;
+  }
+  return next;
+}
+
+void ImpairedDriver::freeSlot(uint8_t slot){
+  slots[slot].used = false;
+  held[slots[slot].direction]--;
+}
+
+void ImpairedDriver::transmit(const uint8_t* frame, uint16_t len){
+  if (!inner->getSendBuffer()->write(0,frame,len)) return;
+  inner->sendFrame(len);
+}
+
+void ImpairedDriver::sendDue(){
+  int16_t slot;
+  while((slot = nextDue(IMPAIR_TX)) >= 0){
+    transmit(slots[slot].data,slots[slot].len);
+    freeSlot(slot);
+  }
+}
+
+/* ======================================================================= */
+/*                 D A T A      B U F F E R     A C C E S S                */
+/* ======================================================================= */
+Buffer* ImpairedDriver::getSendBuffer(){ return sendBuffer; }
+Buffer* ImpairedDriver::getReceiveBuffer(){ return recvBuffer; }
+Buffer* ImpairedDriver::getStashBuffer(){ return inner->getStashBuffer(); }
+
+/* ======================================================================= */
+/*                    S E N D      A N D      R E C E I V E                */
+/* ======================================================================= */
+void ImpairedDriver::sendFrame(uint16_t len){
+  if (len > maxFrameLength) return;
+
+  //anything that has become due goes out ahead of this frame
+  sendDue();
+
+  if (offer(IMPAIR_TX,sendBuffer,len))
+    transmit(sendData,len);
+
+  //a duplicate may be due straight away
+  sendDue();
+}
+
+uint16_t ImpairedDriver::receiveFrame(){
+
+  //receiveFrame is called on every loop, so this is where frames
+  //we are holding on the way out are released
+  sendDue();
+
+  //frames we have held are delivered ahead of new ones
+  int16_t slot = nextDue(IMPAIR_RX);
+  if (slot < 0){
+    Buffer* frame = inner->getReceiveBuffer();
+    uint16_t len = inner->receiveFrame();
+    if (len == 0 || len > maxFrameLength) return 0;
+
+    if (offer(IMPAIR_RX,frame,len)){
+      if (!frame->read(0,recvData,len)) return 0;
+      return len;
+    }
+
+    //it was held, but may already be due
+    slot = nextDue(IMPAIR_RX);
+    if (slot < 0) return 0;
+  }
+
+  uint16_t len = slots[slot].len;
+  memcpy(recvData,slots[slot].data,len);
+  freeSlot(slot);
+  return len;
+}
+
+uint8_t ImpairedDriver::getPendingFrames(){
+  return held[IMPAIR_RX] + inner->getPendingFrames();
+}
+
+/* ======================================================================= */
+/*                      P O W E R     M A N A G E M E N T                  */
+/* ======================================================================= */
+bool ImpairedDriver::isLinkUp(){ return inner->isLinkUp(); }
+void ImpairedDriver::powerDown(){ inner->powerDown(); }
+void ImpairedDriver::powerUp(){ inner->powerUp(); }
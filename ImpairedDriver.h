@@ -0,0 +1,161 @@
+/*
+ *  An EthernetDriver that sits between the EtherControl and a real driver
+ *  and degrades the link in a controlled way.  Use it to see how the
+ *  protocol handlers (TCP retransmission, ARP retries, DNS failover)
+ *  behave on a poor link:
+ *
+ *     driver = new TapDriver(mymac,"tap0");
+ *     impaired = new ImpairedDriver(driver);
+ *     control = new EtherControl(impaired);
+ *
+ *     impairment cfg = {0};
+ *     cfg.lossPct = 5;          //drop 5% of frames
+ *     cfg.latency = 40;         //delay the rest by 40ms...
+ *     cfg.jitter = 10;          //...give or take 10ms
+ *     impaired->setImpairment(IMPAIR_TX,&cfg);
+ *     impaired->setImpairment(IMPAIR_RX,&cfg);
+ *
+ *  Each direction is configured separately and may be changed at any
+ *  time.  The impairments are applied in the following order:
+ *
+ *    loss       the frame is discarded
+ *    duplicate  the frame is delivered twice
+ *    reorder    the frame skips the latency/jitter delay and therefore
+ *               overtakes frames that are still being delayed (this is
+ *               the same model netem uses; it has no effect without a
+ *               latency)
+ *    latency    every other frame is held for latency +/- jitter ms
+ *    bandwidth  frames leave the link no faster than the given number
+ *               of bytes per second; frames queue behind each other
+ *
+ *  Delayed frames are held in a fixed number of slots shared by both
+ *  directions.  When every slot is in use, further frames that need to
+ *  be delayed are dropped and counted as overflows, much like a router
+ *  with a full queue.  Frames that are sent are released from
+ *  sendFrame() and receiveFrame(), so EtherControl::processFrame must be
+ *  called regularly (it already must be).
+ *
+ *  Random decisions use random(), so a run can be repeated exactly by
+ *  calling Host::setRandomSeed and driving the stack with a
+ *  SimulatedClock.
+ */
+#ifndef IMPAIREDDRIVER_H
+#define IMPAIREDDRIVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <EthernetDriver.h>
+#include <MemBuffer.h>
+
+#define IMPAIR_TX 0  //frames sent by the EtherControl
+#define IMPAIR_RX 1  //frames received from the inner driver
+
+typedef struct impairment {
+  uint8_t lossPct;
+  uint8_t duplicatePct;
+  uint8_t reorderPct;
+  uint16_t latency;     //milliseconds
+  uint16_t jitter;      //milliseconds either side of the latency
+  uint32_t bandwidth;   //bytes per second; zero for no limit
+} impairment;
+
+typedef struct impairmentStats {
+  uint32_t frames;      //frames offered in this direction
+  uint32_t lost;
+  uint32_t duplicated;
+  uint32_t reordered;
+  uint32_t delayed;
+  uint32_t overflows;   //dropped because no slot was free
+} impairmentStats;
+
+typedef struct impairedSlot {
+  bool used;
+  uint8_t direction;
+  uint16_t len;
+  uint32_t releaseTime;
+  uint32_t sequence;    //keeps frames with equal release times in order
+  uint8_t* data;
+} impairedSlot;
+
+class ImpairedDriver: public EthernetDriver {
+
+  EthernetDriver* inner;
+
+  impairment config[2];
+  impairmentStats stats[2];
+
+  //time at which the link is free again for each direction when a
+  //bandwidth limit is set, and the byte-milliseconds not yet accounted for
+  uint32_t busyUntil[2];
+  uint32_t busyResidue[2];
+
+  impairedSlot* slots;
+  uint8_t slotCapacity;
+  uint8_t held[2];
+  uint32_t sequence;
+
+  uint16_t maxFrameLength;
+  uint8_t* sendData;
+  uint8_t* recvData;
+  MemBuffer* sendBuffer;
+  MemBuffer* recvBuffer;
+
+  bool chance(uint8_t pct);
+  uint32_t releaseTime(uint8_t direction, uint16_t len, bool reorder);
+  void hold(uint8_t direction, Buffer* frame, uint16_t len,
+	    uint32_t releaseTime);
+  bool offer(uint8_t direction, Buffer* frame, uint16_t len);
+  int16_t nextDue(uint8_t direction);
+  void freeSlot(uint8_t slot);
+  void transmit(const uint8_t* frame, uint16_t len);
+  void sendDue();
+
+public:
+
+  ImpairedDriver(EthernetDriver* inner, uint8_t slotCapacity = 8,
+		 uint16_t maxFrameLength = 1514);
+  ~ImpairedDriver();
+
+  EthernetDriver* getInnerDriver();
+
+  //copy the settings for one direction (IMPAIR_TX or IMPAIR_RX)
+  void setImpairment(uint8_t direction, const impairment* cfg);
+  impairment* getImpairment(uint8_t direction);
+
+  //turn off all impairments and send any held frames straight away
+  void clearImpairments();
+
+  impairmentStats* getStats(uint8_t direction);
+  void resetStats();
+
+  //the number of frames currently being held
+  uint8_t getHeldFrames();
+
+  //milliseconds until the next held frame is released (0xFFFFFFFF if
+  //none are held).  Useful together with EtherControl::getMillisToNextTimer
+  //when running on a SimulatedClock
+  uint32_t getMillisToNextRelease();
+
+  Buffer* getSendBuffer();
+  Buffer* getReceiveBuffer();
+  Buffer* getStashBuffer();
+
+  void sendFrame (uint16_t len);
+  uint16_t receiveFrame();
+
+  //frames held on the way in, due or not, and those waiting on the
+  //inner driver
+  uint8_t getPendingFrames();
+
+  //the inner driver does the filtering; frames it turns away are
+  //never offered to the impairments
+  bool setReceiveFilter(const receiveFilter* f){
+    return inner->setReceiveFilter(f);
+  }
+
+  bool isLinkUp ();
+  void powerDown();
+  void powerUp();
+};
+
+#endif
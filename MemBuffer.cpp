@@ -29,14 +29,57 @@ uint16_t MemBuffer::size(){
 
 bool MemBuffer::write(uint16_t offset, const void* data, uint16_t len){
   if (offset + len > this->size()) return false;
-  memcpy(this->buffer+offset,data,len);
+  //the data may come from this very buffer (see copyTo)
+  memmove(this->buffer+offset,data,len);
   return true;
 }
 
 bool MemBuffer::read(uint16_t offset, void* data, uint16_t len){
   if (offset + len > this->size()) return false;
-  memcpy(data,this->buffer+offset,len);
+  memmove(data,this->buffer+offset,len);
   return true;
 }
 
+bool MemBuffer::copyTo(Buffer* destination, uint16_t dest_start, 
+		       uint16_t src_start, uint16_t len){
+
+  if (len == 0){
+    len = size();
+    if (destination->size() < len) len = destination->size();
+  }
+
+  if (src_start + len > size()) return false;
+  if (dest_start + len > destination->size()) return false; 
+
+  return destination->write(dest_start,this->buffer+src_start,len);
+}//end copyTo
+
+bool MemBuffer::copyFrom(Buffer* source, uint16_t dest_start,
+			 uint16_t src_start, uint16_t len){
+
+  if (len == 0){
+    len = source->size();
+    if (size() < len) len = size();
+  }
+
+  if (src_start + len > source->size()) return false;
+  if (dest_start + len > size()) return false; 
+
+  //read and write both cope with the ranges overlapping, which they
+  //may if the source is a view onto this buffer
+  return source->read(src_start,this->buffer+dest_start,len);
+}//end copyFrom
+
+//sum the words where they are rather than copying them out first
+uint32_t MemBuffer::partialChecksum(uint16_t offset, uint16_t len,
+				    uint32_t sum){
+  if (offset + len > this->size()) return sum;
+  return sumWords(this->buffer+offset,len,sum);
+}
+
+uint8_t* MemBuffer::span(uint16_t offset, uint16_t len){
+  if (offset + len > this->size()) return NULL;
+  return this->buffer+offset;
+}
+
 uint8_t MemBuffer::getBufferType() { return MemBuffer::BufferType; }
@@ -19,6 +19,16 @@ class MemBuffer: public Buffer {
   bool write(uint16_t offset, const void* data, uint16_t len);
   bool read(uint16_t offset, void* data, uint16_t len);
 
+  //our data is contiguous, so either side of the copy can be handed
+  //to the other buffer in a single read or write
+  bool copyTo(Buffer* destination, uint16_t dest_start = 0, 
+	      uint16_t src_start = 0, uint16_t len = 0);
+  bool copyFrom(Buffer* source, uint16_t dest_start = 0,
+		uint16_t src_start = 0, uint16_t len = 0);
+
+  uint32_t partialChecksum(uint16_t offset, uint16_t len, uint32_t sum = 0);
+  uint8_t* span(uint16_t offset, uint16_t len);
+
   uint8_t getBufferType();
   const static uint8_t BufferType = 1;
 };
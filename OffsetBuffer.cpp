@@ -14,10 +14,18 @@ bool OffsetBuffer::reinit(Buffer *buffer,uint16_t offset, uint16_t length){
     offset = buffer->size();
     retval = false;
   }
-  this->offset = offset;
 
-  //set the inner buffer
-  this->innerBuffer = buffer;
+  //work out where the window sits in the root buffer.  An OffsetBuffer
+  //has already done this for itself
+  if (buffer->getBufferType() == OffsetBuffer::BufferType){
+    OffsetBuffer* inner = static_cast<OffsetBuffer*>(buffer);
+    this->root = inner->root;
+    this->rootOffset = inner->rootOffset + offset;
+  }
+  else {
+    this->root = buffer;
+    this->rootOffset = offset;
+  }
 
   //set the length safely
   this->bufferLength = buffer->size() - offset; //default
@@ -36,39 +44,38 @@ uint16_t OffsetBuffer::size(){
 }
 
 Buffer* OffsetBuffer::getRootBuffer(){
-  OffsetBuffer* b = this;
-  while (b->innerBuffer->getBufferType() == OffsetBuffer::BufferType)
-    b = static_cast<OffsetBuffer*>(b->innerBuffer);
-
-  return b->innerBuffer;
+  return this->root;
 }
 
 uint16_t OffsetBuffer::getRootBufferOffset(){
-
-  OffsetBuffer* b = this;
-  uint16_t offset = b->offset;
-  while (b->innerBuffer->getBufferType() == OffsetBuffer::BufferType){
-    b = static_cast<OffsetBuffer*>(b->innerBuffer);
-    offset += b->offset;
-  }
-
-  return offset;
+  return this->rootOffset;
 }
 
-#include <Arduino.h>
 bool OffsetBuffer::write(uint16_t start, const void* data, uint16_t len){
 
   //make sure we are within the bounds of the offset buffer
   if (start+len > this->size()) return false;
 
-  return this->innerBuffer->write(this->offset+start,data,len);
+  return this->root->write(this->rootOffset+start,data,len);
 }
 
 bool OffsetBuffer::read(uint16_t start, void* data, uint16_t len){
   //make sure we are within the bounds of the offset buffer
   if (start+len > this->size()) return false;
 
-  return this->innerBuffer->read(this->offset+start,data,len);
+  return this->root->read(this->rootOffset+start,data,len);
+}
+
+//let the root buffer sum in the way that suits it best
+uint32_t OffsetBuffer::partialChecksum(uint16_t start, uint16_t len,
+				       uint32_t sum){
+  if (start+len > this->size()) return sum;
+  return this->root->partialChecksum(this->rootOffset+start,len,sum);
+}
+
+uint8_t* OffsetBuffer::span(uint16_t start, uint16_t len){
+  if (start+len > this->size()) return NULL;
+  return this->root->span(this->rootOffset+start,len);
 }
 
 uint8_t OffsetBuffer::getBufferType() { return OffsetBuffer::BufferType; }
@@ -88,21 +95,33 @@ bool OffsetBuffer::copyTo(Buffer* destination,uint16_t dest_start,
     //make sure we are within the bounds of the offset buffers
     if (len + dest_start > destination->size()) return false;
 
-    return this->getRootBuffer()->
-      copyTo(destOffBuff->getRootBuffer(),
-	     dest_start + destOffBuff->getRootBufferOffset(),
-	     src_start + this->getRootBufferOffset(),
+    return this->root->
+      copyTo(destOffBuff->root,
+	     dest_start + destOffBuff->rootOffset,
+	     src_start + this->rootOffset,
 	     len);
   }
   
   //otherwise...
 
-  return this->getRootBuffer()->copyTo(destination,dest_start,
-				       src_start + this->getRootBufferOffset(),
-				       len);
+  return this->root->copyTo(destination,dest_start,
+			    src_start + this->rootOffset,len);
 }//end copyTo
 
 bool OffsetBuffer::copyFrom(Buffer* source, uint16_t dest_start,
 		      uint16_t src_start, uint16_t len){
-  return source->copyTo(this,dest_start,src_start,len);
+
+  if (len == 0){
+    len = source->size();
+    if (size() < len) len = size();
+  }
+
+  //make sure we are within the bounds of the offset buffer
+  if (len + dest_start > this->size()) return false;
+
+  //let the root buffer receive the data; it knows the fastest way.
+  //(Handing the copy back to source->copyTo would come straight back
+  //here for sources that delegate copies into OffsetBuffers to us)
+  return this->root->copyFrom(source,dest_start+this->rootOffset,
+			      src_start,len);
 }//end copyFrom
@@ -4,11 +4,16 @@
 #include <stdint.h>
 #include <Buffer.h>
 
+//A window onto part of another buffer.  Windows onto windows are
+//flattened when the OffsetBuffer is (re)initialised: it keeps the root
+//buffer and its offset into it, so every access goes straight to the
+//root however deeply the windows are nested.  Reinitialise a window
+//after reinitialising the window it was made from.
 class OffsetBuffer : public Buffer {
   
   uint16_t bufferLength;
-  uint16_t offset;
-  Buffer *innerBuffer;
+  uint16_t rootOffset;
+  Buffer *root;
 
  public: 
   Buffer* getRootBuffer();
@@ -21,6 +26,9 @@ class OffsetBuffer : public Buffer {
   bool write(uint16_t offset, const void* data, uint16_t len);
   bool read(uint16_t offset, void* data, uint16_t len);
 
+  uint32_t partialChecksum(uint16_t offset, uint16_t len, uint32_t sum = 0);
+  uint8_t* span(uint16_t offset, uint16_t len);
+
   bool copyTo(Buffer* destination, uint16_t dest_start = 0, 
 	      uint16_t src_start = 0, uint16_t len = 0);
   bool copyFrom(Buffer* source, uint16_t start = 0,
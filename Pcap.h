@@ -0,0 +1,41 @@
+/*
+ *  Definitions for the libpcap capture file format.  A capture file is
+ *  a pcapFileHeader followed by any number of records, each of which is
+ *  a pcapRecordHeader followed by inclLen bytes of frame data.
+ *
+ *  All fields are written in the byte order of the host that wrote the
+ *  file.  A reader detects the byte order from the magic number.
+ *
+ *  See https://wiki.wireshark.org/Development/LibpcapFileFormat
+ */
+#ifndef PCAP_H
+#define PCAP_H
+
+#include <stdint.h>
+
+#define PCAP_MAGIC          0xA1B2C3D4  //microsecond timestamps
+#define PCAP_MAGIC_SWAPPED  0xD4C3B2A1
+#define PCAP_MAGIC_NANO     0xA1B23C4D  //nanosecond timestamps
+#define PCAP_MAGIC_NANO_SWAPPED 0x4D3CB2A1
+#define PCAP_VERSION_MAJOR  2
+#define PCAP_VERSION_MINOR  4
+#define PCAP_LINKTYPE_ETHERNET 1
+
+typedef struct pcapFileHeader {
+  uint32_t magic;
+  uint16_t versionMajor;
+  uint16_t versionMinor;
+  int32_t  thisZone;
+  uint32_t sigFigs;
+  uint32_t snapLen;
+  uint32_t linkType;
+} pcapFileHeader;
+
+typedef struct pcapRecordHeader {
+  uint32_t tsSec;
+  uint32_t tsFrac;   //micro or nanoseconds, depending on the magic
+  uint32_t inclLen;  //bytes of frame data stored in the file
+  uint32_t origLen;  //length of the frame on the wire
+} pcapRecordHeader;
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ * This is an EthernetDriver implementation that replays a pcap file.
+ * See PcapReplayDriver.h for details.
+ */
+
+#if !defined(ARDUINO)
+
+#include <string.h>
+#include <hostutil.h>
+#include "Pcap.h"
+#include "PcapReplayDriver.h"
+
+/* ======================================================================= */
+/*                            I N I T I A L I Z E                          */
+/* ======================================================================= */
+PcapReplayDriver::PcapReplayDriver(uint8_t* mac, const char* path,
+				   uint8_t mode, bool loop):
+  EthernetDriver(mac){
+
+  this->sendBuffer = new MemBuffer(PCAP_REPLAY_MAX_FRAMELEN,sendData);
+  this->recvBuffer = new MemBuffer(PCAP_REPLAY_MAX_FRAMELEN,recvData);
+  this->stashBuffer = new MemBuffer(PCAP_REPLAY_STASH_SIZE,stashData);
+
+  this->mode = mode;
+  this->loop = loop;
+  this->swapped = false;
+  this->nanoseconds = false;
+  this->framesReplayed = 0;
+  this->framesSkipped = 0;
+  this->framesSent = 0;
+  this->bytesSent = 0;
+
+  this->file = fopen(path,"rb");
+  if (this->file == NULL){
+#ifdef DEBUG
+    fprintf(stderr,"Err: could not open pcap file %s\n",path);
+#endif
+    return;
+  }
+
+  pcapFileHeader header;
+  bool valid = fread(&header,sizeof(header),1,file) == 1;
+
+  if (valid){
+    switch(header.magic){
+    case PCAP_MAGIC:              break;
+    case PCAP_MAGIC_SWAPPED:      swapped = true; break;
+    case PCAP_MAGIC_NANO:         nanoseconds = true; break;
+    case PCAP_MAGIC_NANO_SWAPPED: nanoseconds = true; swapped = true; break;
+    default:                      valid = false;
+    }
+  }
+
+  if (valid && fix32(header.linkType) != PCAP_LINKTYPE_ETHERNET)
+    valid = false;
+
+  if (!valid){
+#ifdef DEBUG
+    fprintf(stderr,"Err: %s is not an ethernet pcap file\n",path);
+#endif
+    fclose(file);
+    file = NULL;
+    return;
+  }
+
+  rewind();
+}
+
+PcapReplayDriver::~PcapReplayDriver(){
+  if (file != NULL)
+    fclose(file);
+  delete sendBuffer;
+  delete recvBuffer;
+  delete stashBuffer;
+}
+
+/* ======================================================================= */
+/*                        P R I V A T E    H E L P E R S                   */
+/* ======================================================================= */
+uint32_t PcapReplayDriver::fix32(uint32_t value){
+  if (!swapped) return value;
+  return HTONL(value);
+}
+
+//millis after the first frame in the file at which a record is due
+uint32_t PcapReplayDriver::recordTime(const pcapRecordHeader* record){
+  uint32_t sec = fix32(record->tsSec);
+  uint32_t frac = fix32(record->tsFrac);
+  uint32_t divisor = nanoseconds ? 1000000 : 1000;
+  return (sec*1000 + frac/divisor) - (firstSec*1000 + firstFrac/divisor);
+}
+
+//true if a frame due at the given time may be replayed now
+bool PcapReplayDriver::due(uint32_t time){
+  return mode != PCAP_REPLAY_TIMED || host_millis() - replayStart >= time;
+}
+
+//loads the next frame in the file into the receive buffer
+bool PcapReplayDriver::readNextFrame(){
+  bool rewound = false;
+
+  while (true){
+    pcapRecordHeader record;
+    if (fread(&record,sizeof(record),1,file) != 1){
+      //only rewind once per call so that an empty capture
+      //does not send us around in circles
+      if (!loop || rewound) return false;
+      fseek(file,sizeof(pcapFileHeader),SEEK_SET);
+      started = false; //timestamps restart with the first frame
+      rewound = true;
+      continue;
+    }
+
+    uint32_t inclLen = fix32(record.inclLen);
+
+    //a record too short to hold an ethernet header is no frame at all
+    if (inclLen > PCAP_REPLAY_MAX_FRAMELEN ||
+	inclLen < PCAP_REPLAY_MIN_FRAMELEN){
+      framesSkipped++;
+      if (fseek(file,inclLen,SEEK_CUR) != 0) return false;
+      continue;
+    }
+
+    if (fread(recvData,1,inclLen,file) != inclLen) return false;
+
+    //convert the timestamp to millis after the first frame
+    if (!started){
+      started = true;
+      firstSec = fix32(record.tsSec);
+      firstFrac = fix32(record.tsFrac);
+      replayStart = host_millis();
+    }
+    pendingTime = recordTime(&record);
+
+    pendingLen = (uint16_t)inclLen;
+    pending = true;
+    return true;
+  }
+}
+
+/* ======================================================================= */
+/*                 D A T A      B U F F E R     A C C E S S                */
+/* ======================================================================= */
+Buffer* PcapReplayDriver::getSendBuffer(){ return sendBuffer; }
+Buffer* PcapReplayDriver::getReceiveBuffer(){ return recvBuffer; }
+Buffer* PcapReplayDriver::getStashBuffer(){ return stashBuffer; }
+
+/* ======================================================================= */
+/*                    S E N D      A N D      R E C E I V E                */
+/* ======================================================================= */
+void PcapReplayDriver::sendFrame(uint16_t len){
+  framesSent++;
+  bytesSent += len;
+}
+
+uint16_t PcapReplayDriver::receiveFrame(){
+  if (file == NULL) return 0;
+
+  if (!pending && !readNextFrame()) return 0;
+
+  //in timed mode, hold the frame until its time has come
+  if (!due(pendingTime))
+    return 0;
+
+  pending = false;
+  framesReplayed++;
+  return pendingLen;
+}
+
+uint8_t PcapReplayDriver::getPendingFrames(){
+  if (file == NULL) return 0;
+  if (pending) return due(pendingTime) ? 1 : 0;
+
+  //peek at the next record's header and put it back
+  long at = ftell(file);
+  pcapRecordHeader record;
+  bool found = fread(&record,sizeof(record),1,file) == 1;
+
+  //a looping replay starts over, with its first frame due at once.
+  //Otherwise the file is done with, and stays at its end
+  if (!found) return loop && framesReplayed > 0 ? 1 : 0;
+  fseek(file,at,SEEK_SET);
+
+  //before the first frame there is nothing to be early for
+  if (!started) return 1;
+  return due(recordTime(&record)) ? 1 : 0;
+}
+
+void PcapReplayDriver::rewind(){
+  if (file == NULL) return;
+  fseek(file,sizeof(pcapFileHeader),SEEK_SET);
+  pending = false;
+  started = false;
+}
+
+/* ======================================================================= */
+/*                      P O W E R     M A N A G E M E N T                  */
+/* ======================================================================= */
+bool PcapReplayDriver::isLinkUp(){
+  return isOpen();
+}
+
+void PcapReplayDriver::powerDown(){ }
+void PcapReplayDriver::powerUp(){ }
+
+/* ======================================================================= */
+/*                                A C C E S S O R S                        */
+/* ======================================================================= */
+bool PcapReplayDriver::isOpen(){
+  return file != NULL;
+}
+
+bool PcapReplayDriver::isFinished(){
+  if (file == NULL) return true;
+  if (loop || pending) return false;
+  return feof(file) != 0;
+}
+
+uint32_t PcapReplayDriver::getFramesReplayed(){ return framesReplayed; }
+uint32_t PcapReplayDriver::getFramesSkipped(){ return framesSkipped; }
+uint32_t PcapReplayDriver::getFramesSent(){ return framesSent; }
+uint32_t PcapReplayDriver::getBytesSent(){ return bytesSent; }
+
+#endif
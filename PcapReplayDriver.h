@@ -0,0 +1,118 @@
+/*
+ *  An EthernetDriver implementation that replays the frames stored in
+ *  a libpcap capture file through receiveFrame().  Frames sent through
+ *  the driver are counted and discarded.
+ *
+ *  This allows the receive path (EtherControl::processFrame through
+ *  IPHandler, UDPHandler and TCPHandler) to be benchmarked on a host
+ *  against real captures such as ARP storms, broadcast chatter or DNS
+ *  bursts.  Two replay modes are supported:
+ *
+ *     PCAP_REPLAY_FAST  - every call to receiveFrame() returns the next
+ *                         frame in the file
+ *     PCAP_REPLAY_TIMED - frames are returned no earlier than their
+ *                         recorded offset from the first frame in the
+ *                         file, as measured by host_millis()
+ *
+ *  When looping is enabled the file is rewound after the last frame,
+ *  which allows a short capture to drive an arbitrarily long benchmark.
+ *
+ *  Only ethernet captures (link type 1) are supported.  Frames larger
+ *  than PCAP_REPLAY_MAX_FRAMELEN, and records too short to hold an
+ *  ethernet header, are skipped and counted.
+ */
+#ifndef PCAPREPLAYDRIVER_H
+#define PCAPREPLAYDRIVER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <EthernetDriver.h>
+#include <MemBuffer.h>
+#include <Pcap.h>
+
+#define PCAP_REPLAY_FAST  0
+#define PCAP_REPLAY_TIMED 1
+
+//largest frame we will replay or accept for sending, excluding the CRC
+#define PCAP_REPLAY_MAX_FRAMELEN 1514
+
+//smallest frame we will replay: an ethernet header
+#define PCAP_REPLAY_MIN_FRAMELEN 14
+
+//the same amount of spare memory the ENC28J60 offers
+#define PCAP_REPLAY_STASH_SIZE   3584
+
+class PcapReplayDriver: public EthernetDriver {
+
+  FILE* file;
+  bool swapped;
+  bool nanoseconds;
+  uint8_t mode;
+  bool loop;
+
+  //the frame currently held in recvData waiting for its replay time
+  bool pending;
+  uint16_t pendingLen;
+  uint32_t pendingTime;  //millis after the first frame in the file
+
+  bool started;
+  uint32_t firstSec;
+  uint32_t firstFrac;
+  uint32_t replayStart;
+
+  uint32_t framesReplayed;
+  uint32_t framesSkipped;
+  uint32_t framesSent;
+  uint32_t bytesSent;
+
+  uint8_t sendData[PCAP_REPLAY_MAX_FRAMELEN];
+  uint8_t recvData[PCAP_REPLAY_MAX_FRAMELEN];
+  uint8_t stashData[PCAP_REPLAY_STASH_SIZE];
+
+  MemBuffer *sendBuffer;
+  MemBuffer *recvBuffer;
+  MemBuffer *stashBuffer;
+
+  uint32_t fix32(uint32_t value);
+  uint32_t recordTime(const pcapRecordHeader* record);
+  bool due(uint32_t time);
+  bool readNextFrame();
+
+public:
+
+  PcapReplayDriver(uint8_t* mac, const char* path,
+		   uint8_t mode = PCAP_REPLAY_FAST, bool loop = false);
+  ~PcapReplayDriver();
+
+  Buffer* getSendBuffer();
+  Buffer* getReceiveBuffer();
+  Buffer* getStashBuffer();
+
+  void sendFrame (uint16_t len);
+  uint16_t receiveFrame();
+
+  //1 if receiveFrame would return a frame now (in timed mode, only
+  //once its time has come), otherwise 0.  The next record is peeked
+  //at, so the frame in the receive buffer is left alone
+  uint8_t getPendingFrames();
+
+  bool isLinkUp ();
+  void powerDown();
+  void powerUp();
+
+  //true if the file was opened and has a valid ethernet pcap header
+  bool isOpen();
+
+  //true once every frame has been replayed (never true when looping)
+  bool isFinished();
+
+  //start the replay again from the first frame in the file
+  void rewind();
+
+  uint32_t getFramesReplayed();
+  uint32_t getFramesSkipped();
+  uint32_t getFramesSent();
+  uint32_t getBytesSent();
+};
+
+#endif
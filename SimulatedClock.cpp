@@ -0,0 +1,17 @@
+#include "SimulatedClock.h"
+
+SimulatedClock::SimulatedClock(uint32_t start){
+  this->now = start;
+}
+
+uint32_t SimulatedClock::getMillis(){
+  return this->now;
+}
+
+void SimulatedClock::setMillis(uint32_t millis){
+  this->now = millis;
+}
+
+void SimulatedClock::advance(uint32_t millis){
+  this->now += millis;
+}
@@ -0,0 +1,43 @@
+/*
+ *  A ClockSource whose time only moves when told to.  Installing a
+ *  SimulatedClock with Host::setClockSource() puts every timeout in the
+ *  stack (timers, ARP and DNS retries, Socket ACK waits and TIME_WAIT,
+ *  DNS TTLs) on virtual time.  Tests and benchmarks can then skip
+ *  straight to the next deadline instead of waiting for it:
+ *
+ *      SimulatedClock clock;
+ *      Host::setClockSource(&clock);
+ *      ...
+ *      while (...) {
+ *        control->processFrame();
+ *        if (nothing left to receive){
+ *          uint32_t next = control->getMillisToNextTimer();
+ *          if (next != 0xFFFFFFFF) clock.advance(next);
+ *        }
+ *      }
+ *
+ *  which runs hours of retransmission and expiry behaviour in moments
+ *  and always in the same order.  With no timers registered
+ *  getMillisToNextTimer returns 0xFFFFFFFF; advancing by that would
+ *  move the clock on some 49 days and make every deadline due at once.
+ */
+#ifndef SIMULATEDCLOCK_H
+#define SIMULATEDCLOCK_H
+
+#include <stdint.h>
+#include <ClockSource.h>
+
+class SimulatedClock: public ClockSource {
+
+  uint32_t now;
+
+ public:
+  SimulatedClock(uint32_t start = 0);
+
+  uint32_t getMillis();
+
+  void setMillis(uint32_t millis);
+  void advance(uint32_t millis);
+};
+
+#endif
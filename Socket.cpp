@@ -8,10 +8,15 @@
 #include <string.h>
 #include <stdio.h>
 #include <hostutil.h>
+#include <Headers.h>
 #include "Socket.h"
 #include "IPHandler.h"
 #include "DNSHandler.h"
 
+#if defined(ARDUINO)
+#include <Arduino.h>
+#endif
+
 
 /* ====================================================================== */
 /*                         C O N S T R U C T O R S                        */
@@ -24,6 +29,7 @@ void Socket::init(){
   this->tcp = NULL;
   this->attempts = 0;
   this->lastDataLength = 0;
+  this->lastDataSum = 0;
   this->stash = NULL;
   this->recvBuffer = NULL;
   this->sendBuffer = NULL;
@@ -65,7 +71,7 @@ Socket::~Socket(){
     delete this->sendBuffer;
   this->sendBuffer = NULL;
 }
-#include <Arduino.h>
+
 /* ====================================================================== */
 /*                      D N S    R E S O L U T I O N                      */
 /* ====================================================================== */
@@ -327,31 +333,46 @@ bool Socket::send(uint16_t length){
   if (length > this->getMaxSendPayload())
     return false;
 
-  //make this our first attempt
-  attempts = 1;
-
-  //copy the data to the stash in case we need to resend
+  //copy the data to the stash in case we need to resend, summing it on
+  //the way for the checksum
   Buffer* sb = getSendDataBuffer();
   if (sb == NULL) return false;
-  if (!sb->copyTo(stash,0,0,length)) return false;
+  uint32_t sum = 0;
+  if (!sb->copyToAndSum(stash,0,0,length,&sum)) return false;
 
-  //send the data out
-  if (sendSegment(ACK | PSH,length)){
-    this->stateTime = host_millis();
-    return true;
-  }
-  return false;
+  //send the data out from where it is
+  return sendData(length,NULL,sum);
 }
 
 bool Socket::send(uint8_t* data, uint16_t length){
 
-  //copy the data to the tx buffer
-  Buffer* sb = getSendDataBuffer();
-  if (sb == NULL) return false;
-  if (!sb->write(0,data,length)) return false;
+  if (length == 0) return true;
+  if (!readyToSend()) return false;
+  if (length > this->getMaxSendPayload())
+    return false;
 
-  //send it
-  return send(length);
+  //the data has to go to the stash in case we need to resend, so put
+  //it there and send it from there rather than copying it twice.  It
+  //is summed here, where it is cheap to read
+  if (!stash->write(0,data,length)) return false;
+
+  return sendData(length,stash,Buffer::sumWords(data,length));
+}
+
+//send length bytes of new data, either from the send buffer (payload
+//is NULL) or gathered from payload.  sum is the sum of its words
+bool Socket::sendData(uint16_t length, Buffer* payload, uint32_t sum){
+
+  //make this our first attempt
+  attempts = 1;
+
+  //send the data out
+  lastDataSum = sum;
+  if (sendSegment(ACK | PSH,length,0,0,payload,&lastDataSum)){
+    this->stateTime = host_millis();
+    return true;
+  }
+  return false;
 }
 
 bool Socket::send(const char* data){
@@ -430,6 +451,10 @@ void Socket::setState(uint8_t state){
 }
 
 void Socket::closed(){
+  //the next connection has different ports and sequence numbers
+  dataChecksumValid = false;
+  ackChecksumValid = false;
+
   if (tcp != NULL && isHost()){
     setState(LISTEN);
   }
@@ -520,16 +545,22 @@ void Socket::handleSegment(uint8_t* sourceIP, Buffer* buf){
   else
     this->recvBuffer->reinit(buf,buf->size());
 
+  //the fixed part of the header is parsed with plain loads
+  Header<TCPHeader> header;
+  if (!header.load(buf)) return;
+
   //load our options, ACK value, remote seq
-  uint8_t opt;
-  uint32_t ack;
-  uint32_t seq;
-  if (!buf->read8(13,&opt)) return;
-  if (!buf->readNet32(8,&ack)) return;
-  if (!buf->readNet32(4,&seq)) return;
+  uint8_t opt = header.get<TCPHeader::Control>();
+  uint32_t ack = header.get<TCPHeader::Acknowledgement>();
+  uint32_t seq = header.get<TCPHeader::Sequence>();
+  uint16_t sourcePort = header.get<TCPHeader::SourcePort>();
+  uint16_t givenChecksum = header.get<TCPHeader::Checksum>();
+
+  //the size of the header in 4 byte words; in the first 4 bits
+  uint8_t tcp_header_size = header.get<TCPHeader::DataOffset>() >> 4;
 
   //load the window size
-  if (!buf->readNet16(14,&this->remoteWindow)) return;
+  this->remoteWindow = header.get<TCPHeader::Window>();
  
   //before calcing the checksum, we need to have the remoteIP
   //if we're in listen mode then the IP won't be set yet
@@ -539,8 +570,6 @@ void Socket::handleSegment(uint8_t* sourceIP, Buffer* buf){
 
   //now we are ready to verify the checksum
   uint16_t checksum = calcChecksum(buf,buf->size());
-  uint16_t givenChecksum;
-  if (!buf->readNet16(16,&givenChecksum)) return;
   if (givenChecksum != checksum) return; //discard the paket
 
 #ifdef DEBUG
@@ -636,14 +665,6 @@ void Socket::handleSegment(uint8_t* sourceIP, Buffer* buf){
     this->remoteSeq = seq;
     this->remoteSeq++;
     
-    //get the remote port
-    if(!buf->readNet16(2,&(this->remotePort))) return;
-    
-    //get the size of the header
-    uint8_t tcp_header_size;
-    if (!buf->read8(12,&tcp_header_size)) return;
-    tcp_header_size = tcp_header_size >> 4;
-    
     //if we have tcp options set, check for an MSS
     if (tcp_header_size == 6){
       uint32_t tcpopt = 0;
@@ -656,7 +677,7 @@ void Socket::handleSegment(uint8_t* sourceIP, Buffer* buf){
     }
 
     //set the remote port
-    if(!buf->readNet16(0,&this->remotePort)) return;
+    this->remotePort = sourcePort;
 
 
     //send back an ACK+SYN
@@ -673,11 +694,6 @@ void Socket::handleSegment(uint8_t* sourceIP, Buffer* buf){
     this->remoteSeq = seq;
     this->remoteSeq++;
     
-    //get the size of the header
-    uint8_t tcp_header_size;
-    if (!buf->read8(12,&tcp_header_size)) return;
-    tcp_header_size = tcp_header_size >> 4;
-    
     //if we have tcp options set, check for an MSS
     if (tcp_header_size == 6){
       uint32_t tcpopt = 0;
@@ -706,11 +722,6 @@ void Socket::handleSegment(uint8_t* sourceIP, Buffer* buf){
     this->remoteSeq = seq;
     this->remoteSeq++;
     
-    //get the size of the header
-    uint8_t tcp_header_size;
-    if (!buf->read8(12,&tcp_header_size)) return;
-    tcp_header_size = tcp_header_size >> 4;
-    
     //if we have tcp options set, check for an MSS
     if (tcp_header_size == 6){
       uint32_t tcpopt = 0;
@@ -749,9 +760,6 @@ void Socket::handleSegment(uint8_t* sourceIP, Buffer* buf){
     //whether or not the push bit is set, we must check for data
 
     //calculate the payload size
-    uint8_t tcp_header_size; //size is in 4 byte words
-    if (!buf->read8(12,&tcp_header_size)) return;
-    tcp_header_size = tcp_header_size >> 4; //in the first 4 bits so shift
     uint16_t payloadSize = buf->size() - tcp_header_size * 4;
 
     //if we have data
@@ -863,18 +871,17 @@ bool Socket::resendData(){
   //rewind our sequence
   this->localSeq -= lastDataLength;
 
-  //populate the tx buffer with data from the stash
-  Buffer* sb = getSendDataBuffer();
-  if (sb == NULL) return false;
-  if (!sb->copyFrom(stash,0,0,lastDataLength)) return false;
-
-  //send the segment again using data from the stash
-  return sendSegment(ACK,lastDataLength);
+  //send the segment again straight from the stash
+  if (stash == NULL) return false;
+  return sendSegment(ACK,lastDataLength,0,0,stash,&lastDataSum);
 }
  
 bool Socket::sendSegment(uint8_t control,uint16_t length,
-			 uint32_t seq,uint32_t ack){
+			 uint32_t seq,uint32_t ack,Buffer* payload,
+			 const uint32_t* payloadSum){
 
+  //without a TCP handler there is nowhere to send the segment
+  if (tcp == NULL) return false;
 
   //if this is a reset packet, then we have special values
   //for the seq and ack fields otherwise, go with the regulars
@@ -893,21 +900,24 @@ bool Socket::sendSegment(uint8_t control,uint16_t length,
 
 #endif
 
+  //the header is built in place when the send buffer is in memory,
+  //otherwise on the stack and written out in one go
   Buffer* buf = tcp->getIPHandler()->getSendPayloadBuffer();
-  if (!buf->writeNet16(0,localPort)) return false;
-  if (!buf->writeNet16(2,remotePort)) return false;
-  if (!buf->writeNet32(4,seq)) return false; 
-  if (!buf->writeNet32(8,ack)) return false; 
+  Header<TCPHeader,TCPHeader::MSS_LENGTH> header;
+  header.place(buf);
+  header.set<TCPHeader::SourcePort>(localPort);
+  header.set<TCPHeader::DestinationPort>(remotePort);
+  header.set<TCPHeader::Sequence>(seq);
+  header.set<TCPHeader::Acknowledgement>(ack);
   
   uint8_t optionLength = 0;
   if ((control & SYN) == SYN) {
     //create room in the header for a 4 byte option
-    if (!buf->write8(12,6 << 4)) return false;
     //set the maximum segment size
     //this excludes the size of the TCP header
-    if (!buf->write8(20,0x02)) return false;    //MSS option announcement
-    if (!buf->write8(21,0x04)) return false;    //MSS option announcement
-    if (!buf->writeNet16(22,tcp->getMaxSegmentSize())) return false; 
+    header.set<TCPHeader::OptionKind>(0x02);   //MSS option announcement
+    header.set<TCPHeader::OptionLength>(0x04); //MSS option announcement
+    header.set<TCPHeader::MaxSegmentSize>(tcp->getMaxSegmentSize());
     localSeq++;
     optionLength = 4;
   }
@@ -916,7 +926,6 @@ bool Socket::sendSegment(uint8_t control,uint16_t length,
   }
   else {
     //the header can just be 5 words instead of 6 as we have no options to set
-    if (!buf->write8(12,5 << 4)) return false;
     if (length > 0){
       this->state = this->state | AWAITING_ACK;
       lastDataLength = length;
@@ -924,14 +933,81 @@ bool Socket::sendSegment(uint8_t control,uint16_t length,
     }
   }
 
-  if (!buf->write8(13,control)) return false;  //control values
-  if (!buf->writeNet16(14,this->getWindowSize())) return false; //window size 
-  if (!buf->writeNet16(18,0x0000)) return false;   //urg ptr
+  //header length in words and the control values share a word
+  uint16_t headerLength = TCP_HEADER_LENGTH + optionLength;
+  uint16_t flags = ((headerLength / 4) << 12) | control;
+  uint16_t window = this->getWindowSize();
+
+  header.set<TCPHeader::OffsetControl>(flags);
+  header.set<TCPHeader::Window>(window);
+  header.set<TCPHeader::Checksum>(0x0000); //filled in below
+  header.set<TCPHeader::Urgent>(0x0000);
+
+  //data that is not in the send buffer is gathered in behind the header
+  BufferChain chain;
+  Buffer* segment = buf;
+  if (payload != NULL){
+    if (!chain.append(payload,0,length)) return false;
+    if (!chain.prepend(buf,0,headerLength)) return false;
+    segment = &chain;
+  }
 
-  return transmit(length,optionLength);
+  //a segment we have sent before (the same data at the same seq) or
+  //another pure ACK only differs from the last one in a few header
+  //fields, so adjust that checksum rather than reading the whole
+  //segment back out of the buffer
+  uint16_t checksum;
+  if (length > 0 && dataChecksumValid && seq == dataChecksumSeq &&
+      length == dataChecksumLength){
+    checksum = Buffer::adjustChecksum32(dataChecksum,dataChecksumAck,ack);
+    checksum = Buffer::adjustChecksum(checksum,dataChecksumWindow,window);
+    checksum = Buffer::adjustChecksum(checksum,dataChecksumFlags,flags);
+  }
+  else if (length == 0 && control == ACK && ackChecksumValid){
+    checksum = Buffer::adjustChecksum32(ackChecksum,ackChecksumSeq,seq);
+    checksum = Buffer::adjustChecksum32(checksum,ackChecksumAck,ack);
+    checksum = Buffer::adjustChecksum(checksum,ackChecksumWindow,window);
+  }
+  else {
+    //the header is summed where we built it and the data where it is,
+    //unless it has been summed already
+    uint32_t sum = pseudoHeaderSum(length + headerLength);
+    if (payloadSum != NULL)
+      sum += *payloadSum;
+    else
+      sum = segment->partialChecksum(headerLength,length,sum);
+    sum = Buffer::sumWords(header.data(),headerLength,sum);
+    while (sum >> 16)
+      sum = (sum & 0xFFFF) + (sum >> 16);
+    checksum = ~sum;
+  }
+
+  //remember what we sent for next time
+  if (length > 0){
+    dataChecksumValid = true;
+    dataChecksum = checksum;
+    dataChecksumSeq = seq;
+    dataChecksumAck = ack;
+    dataChecksumLength = length;
+    dataChecksumWindow = window;
+    dataChecksumFlags = flags;
+  }
+  else if (control == ACK){
+    ackChecksumValid = true;
+    ackChecksum = checksum;
+    ackChecksumSeq = seq;
+    ackChecksumAck = ack;
+    ackChecksumWindow = window;
+  }
+
+  //and the header goes out in one write, if it isn't there already
+  header.set<TCPHeader::Checksum>(checksum);
+  if (!header.store(buf,0,headerLength)) return false;
+
+  return transmit(length,optionLength,payload == NULL ? NULL : &chain);
 }
 
-uint16_t Socket::calcChecksum(Buffer* buf, uint16_t len){ 
+uint32_t Socket::pseudoHeaderSum(uint16_t len){ 
 
   uint32_t pseudo = 0;  
   
@@ -951,10 +1027,15 @@ uint16_t Socket::calcChecksum(Buffer* buf, uint16_t len){
   pseudo += HTONS(*((uint16_t*)remoteIP));
   pseudo += HTONS(*((uint16_t*)(remoteIP+2)));
 
-  return buf->checksum(len,16,pseudo);
+  return pseudo;
+}
+
+uint16_t Socket::calcChecksum(Buffer* buf, uint16_t len){ 
+  return buf->checksum(len,16,pseudoHeaderSum(len));
 }
 
-bool Socket::transmit(uint16_t length, uint8_t option_length){
+bool Socket::transmit(uint16_t length, uint8_t option_length, 
+		      BufferChain* segment){
 
   //see if we have a route to the host
   if (tcp->getIPHandler()->getMACForIP(this->remoteIP) == NULL){
@@ -963,16 +1044,12 @@ bool Socket::transmit(uint16_t length, uint8_t option_length){
     return true;
   }
 
-  Buffer* buf = tcp->getIPHandler()->getSendPayloadBuffer();
   uint16_t len = length + TCP_HEADER_LENGTH + option_length;  
 
-  //calc the checksum
-  uint16_t checksum = calcChecksum(buf,len);
-
-  //now write the checksum to the buffer
-  if (!buf->writeNet16(16,checksum)) return false;
-  
   //send the IP packet
+  if (segment != NULL)
+    return tcp->getIPHandler()->sendPacket(this->remoteIP,TCP_PROTOCOL,
+					   segment);
   return tcp->getIPHandler()->sendPacket(this->remoteIP,TCP_PROTOCOL,len);
 
 }
@@ -3,6 +3,7 @@
 
 #include <Buffer.h>
 #include <OffsetBuffer.h>
+#include <BufferChain.h>
 #include "DNSHandler.h"
 
 class TCPHandler;
@@ -70,6 +71,23 @@ class Socket{
   OffsetBuffer* recvBuffer;
   OffsetBuffer* sendBuffer;
   uint16_t lastDataLength;
+  uint32_t lastDataSum; //the words of the data in the stash, summed
+
+  //the checksums of the last data segment and the last pure ACK along
+  //with the header fields that may differ the next time they are sent
+  bool dataChecksumValid;
+  uint16_t dataChecksum;
+  uint32_t dataChecksumSeq;
+  uint32_t dataChecksumAck;
+  uint16_t dataChecksumLength;
+  uint16_t dataChecksumWindow;
+  uint16_t dataChecksumFlags;
+
+  bool ackChecksumValid;
+  uint16_t ackChecksum;
+  uint32_t ackChecksumSeq;
+  uint32_t ackChecksumAck;
+  uint16_t ackChecksumWindow;
 
   void init();
   
@@ -78,10 +96,18 @@ class Socket{
 
   bool resendData();
 
+  bool sendData(uint16_t length, Buffer* payload, uint32_t sum);
+
+  //payload, when given, holds the data to send instead of the send
+  //buffer.  payloadSum, when given, is the sum of the data's words so
+  //the data need not be read back to checksum the segment
   bool sendSegment(uint8_t control, uint16_t length, uint32_t seq = 0,
-		   uint32_t ack = 0);
+		   uint32_t ack = 0, Buffer* payload = NULL,
+		   const uint32_t* payloadSum = NULL);
 
-  bool transmit(uint16_t length, uint8_t option_length = 0);
+  bool transmit(uint16_t length, uint8_t option_length = 0,
+		BufferChain* segment = NULL);
+  uint32_t pseudoHeaderSum(uint16_t len);
   uint16_t calcChecksum(Buffer* buf, uint16_t len);
 
 
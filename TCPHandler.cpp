@@ -201,6 +201,11 @@ void TCPHandler::handleTimer(uint8_t index){
   }//end for
 }
 
+//segments are never broadcast
+bool TCPHandler::wantsBroadcasts(){
+  return false;
+}
+
 void TCPHandler::handlePacket(uint8_t* sourceIP, Buffer *packet){
 
   uint16_t sourcePort;
@@ -30,6 +30,7 @@ class TCPHandler: PacketHandler, TimerHandler{
   ~TCPHandler();
 
   void handlePacket(uint8_t* sourceIP, Buffer *packet);
+  bool wantsBroadcasts();
   void handleTimer(uint8_t index);
 
   IPHandler* getIPHandler();
@@ -0,0 +1,148 @@
+/*
+ * This is an EthernetDriver implementation for a Linux TAP device.
+ * See TapDriver.h for details on setting up the interface.
+ */
+
+#if defined(__linux__)
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+#include "TapDriver.h"
+
+//minimum frame length on the wire, excluding the CRC
+#define MIN_FRAMELEN 60
+
+/* ======================================================================= */
+/*                            I N I T I A L I Z E                          */
+/* ======================================================================= */
+TapDriver::TapDriver(uint8_t* mac, const char* interfaceName):
+  EthernetDriver(mac){
+
+  this->sendBuffer = new MemBuffer(TAP_MAX_FRAMELEN,sendData);
+  this->recvBuffer = new MemBuffer(TAP_MAX_FRAMELEN,recvData);
+  this->stashBuffer = new MemBuffer(TAP_STASH_SIZE,stashData);
+  this->poweredUp = true;
+
+  strncpy(this->interfaceName,interfaceName,sizeof(this->interfaceName)-1);
+  this->interfaceName[sizeof(this->interfaceName)-1] = '\0';
+
+  this->fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
+  if (this->fd < 0){
+#ifdef DEBUG
+    fprintf(stderr,"Err: could not open /dev/net/tun: %s\n",strerror(errno));
+#endif
+    return;
+  }
+
+  //attach to the tap interface; IFF_NO_PI means we read and write
+  //raw ethernet frames without the extra packet information header
+  struct ifreq ifr;
+  memset(&ifr,0,sizeof(ifr));
+  ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+  strncpy(ifr.ifr_name,this->interfaceName,IFNAMSIZ-1);
+
+  if (ioctl(this->fd,TUNSETIFF,&ifr) < 0){
+#ifdef DEBUG
+    fprintf(stderr,"Err: could not attach to %s: %s\n",
+	    this->interfaceName,strerror(errno));
+#endif
+    close(this->fd);
+    this->fd = -1;
+  }
+}
+
+TapDriver::~TapDriver(){
+  if (this->fd >= 0)
+    close(this->fd);
+  delete sendBuffer;
+  delete recvBuffer;
+  delete stashBuffer;
+}
+
+/* ======================================================================= */
+/*                 D A T A      B U F F E R     A C C E S S                */
+/* ======================================================================= */
+Buffer* TapDriver::getSendBuffer(){ return sendBuffer; }
+Buffer* TapDriver::getReceiveBuffer(){ return recvBuffer; }
+Buffer* TapDriver::getStashBuffer(){ return stashBuffer; }
+
+/* ======================================================================= */
+/*                    S E N D      A N D      R E C E I V E                */
+/* ======================================================================= */
+void TapDriver::sendFrame(uint16_t len){
+  if (this->fd < 0 || !this->poweredUp) return;
+  if (len > TAP_MAX_FRAMELEN) return;
+
+  //pad short frames just like the ENC28J60 does
+  if (len < MIN_FRAMELEN){
+    memset(sendData+len,0,MIN_FRAMELEN-len);
+    len = MIN_FRAMELEN;
+  }
+
+  if (write(this->fd,sendData,len) < 0){
+#ifdef DEBUG
+    fprintf(stderr,"Err: tap write failed: %s\n",strerror(errno));
+#endif
+  }
+}
+
+uint16_t TapDriver::receiveFrame(){
+  if (this->fd < 0) return 0;
+
+  ssize_t len = read(this->fd,recvData,TAP_MAX_FRAMELEN);
+
+  //EAGAIN simply means there is no frame waiting
+  if (len <= 0) return 0;
+
+  //while powered down, frames are read and dropped just as the
+  //controller would drop them with the receiver disabled
+  if (!this->poweredUp) return 0;
+
+  return (uint16_t)len;
+}
+
+uint8_t TapDriver::getPendingFrames(){
+  if (this->fd < 0) return 0;
+
+  struct pollfd waiting;
+  waiting.fd = this->fd;
+  waiting.events = POLLIN;
+  waiting.revents = 0;
+  if (poll(&waiting,1,0) <= 0) return 0;
+  return (waiting.revents & POLLIN) ? 1 : 0;
+}
+
+/* ======================================================================= */
+/*                      P O W E R     M A N A G E M E N T                  */
+/* ======================================================================= */
+bool TapDriver::isLinkUp(){
+  return this->fd >= 0 && this->poweredUp;
+}
+
+void TapDriver::powerDown(){
+  this->poweredUp = false;
+}
+
+void TapDriver::powerUp(){
+  this->poweredUp = true;
+}
+
+/* ======================================================================= */
+/*                                A C C E S S O R S                        */
+/* ======================================================================= */
+int TapDriver::getFileDescriptor(){
+  return this->fd;
+}
+
+const char* TapDriver::getInterfaceName(){
+  return this->interfaceName;
+}
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ *  An EthernetDriver implementation for Linux hosts that is backed by
+ *  a TAP device.  Frames written by the stack are handed to the kernel
+ *  through the TAP file descriptor and frames routed to the TAP interface
+ *  by the kernel are returned by receiveFrame().
+ *
+ *  This allows the full protocol stack (EtherControl, ARPHandler,
+ *  IPHandler, UDPHandler, TCPHandler, ...) to be run, profiled and
+ *  load tested on a workstation at full host speed.
+ *
+ *  The TAP interface must exist and be up before the stack can talk
+ *  to anything, for example:
+ *
+ *       ip tuntap add dev tap0 mode tap user $USER
+ *       ip addr add 192.168.7.1/24 dev tap0
+ *       ip link set tap0 up
+ *
+ *  after which a stack configured with 192.168.7.2 is reachable from
+ *  the host.  The send, receive and stash buffers are MemBuffers, so
+ *  every Buffer operation is a plain memory access.
+ */
+#ifndef TAPDRIVER_H
+#define TAPDRIVER_H
+
+#include <stdint.h>
+#include <EthernetDriver.h>
+#include <MemBuffer.h>
+
+//largest frame we will send or receive, excluding the CRC
+#define TAP_MAX_FRAMELEN   1514
+
+//the same amount of spare memory the ENC28J60 offers
+#define TAP_STASH_SIZE     3584
+
+class TapDriver: public EthernetDriver {
+
+  int fd;
+  bool poweredUp;
+  char interfaceName[16];
+
+  uint8_t sendData[TAP_MAX_FRAMELEN];
+  uint8_t recvData[TAP_MAX_FRAMELEN];
+  uint8_t stashData[TAP_STASH_SIZE];
+
+  MemBuffer *sendBuffer;
+  MemBuffer *recvBuffer;
+  MemBuffer *stashBuffer;
+
+public:
+
+  TapDriver(uint8_t* mac, const char* interfaceName = "tap0");
+  ~TapDriver();
+
+  Buffer* getSendBuffer();
+  Buffer* getReceiveBuffer();
+  Buffer* getStashBuffer();
+
+  void sendFrame (uint16_t len);
+  uint16_t receiveFrame();
+
+  //1 if a frame is waiting on the TAP device; the kernel won't say
+  //how many there are
+  uint8_t getPendingFrames();
+
+  bool isLinkUp ();
+  void powerDown();
+  void powerUp();
+
+  //the file descriptor of the TAP device (or -1 if it could not be
+  //opened); useful for poll()/select() based main loops
+  int getFileDescriptor();
+  const char* getInterfaceName();
+};
+
+#endif
@@ -11,12 +11,17 @@
  * register a callback function via registerListener(port,datagramReceiver)
  * and the callback will be executed everytime a UDPHandler packet is received
  * on the given port.
+ *
+ * Listeners that want datagrams sent to the broadcast address should
+ * say so when they register; with a receive filter in place, broadcasts
+ * never reach us unless one has.  Once one has, every broadcast does.
  */
 
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <hostutil.h>
+#include <Headers.h>
 #include "UDPHandler.h"
 
 #define DATAGRAM_HEADER_LENGTH 8
@@ -37,6 +42,7 @@ UDPHandler::UDPHandler(IPHandler *ipHandler, uint8_t receiverCount){
   for(int i=0; i<this->receiverCount; i++){
     this->receivers[i].port = 0;
     this->receivers[i].receiver = NULL;
+    this->receivers[i].broadcasts = false;
   }//end for
 
   ipHandler->registerProtocol(UDP_PROTOCOL,this);
@@ -53,13 +59,15 @@ UDPHandler::~UDPHandler(){
 /* ========================================================================= */
 /*                   L I S T E N E R    R E G I S T R A T I O N              */
 /* ========================================================================= */
-bool UDPHandler::registerListener(uint16_t port, DatagramReceiver *receiver){
+bool UDPHandler::registerListener(uint16_t port, DatagramReceiver *receiver,
+				  bool broadcasts){
 
   //see if the port already has a listener
   //if so, replace the existing listener
   for(int i=0; i<receiverCount;i++){
     if (receivers[i].port == port){
       receivers[i].receiver = receiver;
+      receivers[i].broadcasts = broadcasts;
       return true;
     }
   }
@@ -69,6 +77,7 @@ bool UDPHandler::registerListener(uint16_t port, DatagramReceiver *receiver){
     if (receivers[i].receiver == NULL){
       receivers[i].port     = port;
       receivers[i].receiver = receiver;
+      receivers[i].broadcasts = broadcasts;
       return true;
     }
   }
@@ -82,6 +91,7 @@ void UDPHandler::unregisterListener(uint16_t port){
     if(receivers[i].port == port){
       receivers[i].receiver = NULL;
       receivers[i].port = 0;
+      receivers[i].broadcasts = false;
     }//end if
   }//end for
 }
@@ -95,6 +105,14 @@ DatagramReceiver* UDPHandler::getListener(uint16_t port){
   return NULL;
 }//end getListener
 
+bool UDPHandler::wantsBroadcasts(){
+  for(int i=0; i<receiverCount;i++){
+    if (receivers[i].receiver != NULL && receivers[i].broadcasts)
+      return true;
+  }//end for
+  return false;
+}//end wantsBroadcasts
+
 
 /* ========================================================================= */
 /*                                 N E T W O R K                             */
@@ -108,6 +126,25 @@ Buffer* UDPHandler::getSendPayloadBuffer(){
 bool UDPHandler::sendDatagram(uint8_t *destinationIP, 
 			      uint16_t destinationPort, 
 			      uint16_t sourcePort, uint16_t payloadLength){
+  return transmit(destinationIP,destinationPort,sourcePort,payloadLength,
+		  NULL);
+}//end sendDatagram
+
+bool UDPHandler::sendDatagram(uint8_t *destinationIP, 
+			      uint16_t destinationPort, 
+			      uint16_t sourcePort, uint16_t payloadLength,
+			      Buffer *payload){
+  BufferChain chain;
+  if (!chain.append(payload,0,payloadLength)) return false;
+  return transmit(destinationIP,destinationPort,sourcePort,payloadLength,
+		  &chain);
+}//end sendDatagram
+
+//send a datagram whose payload is either already in our send buffer
+//(payload is NULL) or is gathered from payload as it is sent
+bool UDPHandler::transmit(uint8_t *destinationIP, uint16_t destinationPort, 
+			  uint16_t sourcePort, uint16_t payloadLength,
+			  BufferChain *payload){
   
   uint16_t len = DATAGRAM_HEADER_LENGTH + payloadLength;
 
@@ -119,22 +156,39 @@ bool UDPHandler::sendDatagram(uint8_t *destinationIP,
     return false;
   }
 
-  //populate the Datagram packet header
-  if (!datagram->writeNet16(0,sourcePort)) return false;
-  if (!datagram->writeNet16(2,destinationPort)) return false;
-  if (!datagram->writeNet16(4,payloadLength +  DATAGRAM_HEADER_LENGTH )) 
-      return false;
-
-  //calculate the checksum
-  if (!datagram->writeNet16(6,calcChecksum(datagram,len,destinationIP))) 
+  //populate the Datagram packet header, in place if the buffer allows
+  Header<UDPHeader> udp;
+  udp.place(datagram);
+  udp.set<UDPHeader::SourcePort>(sourcePort);
+  udp.set<UDPHeader::DestinationPort>(destinationPort);
+  udp.set<UDPHeader::Length>(len);
+  udp.set<UDPHeader::Checksum>(0);
+
+  //calculate the checksum.  The header is summed where we built it and
+  //the payload where it is, so nothing is read back out of the send
+  //buffer
+  uint32_t sum = pseudoHeaderSum(len,destinationIP);
+  sum = Buffer::sumWords(udp.data(),DATAGRAM_HEADER_LENGTH,sum);
+  if (payload != NULL)
+    sum = payload->partialChecksum(0,payloadLength,sum);
+  else
+    sum = datagram->partialChecksum(DATAGRAM_HEADER_LENGTH,payloadLength,sum);
+  while (sum >> 16)
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  udp.set<UDPHeader::Checksum>(~sum);
+  if (!udp.store(datagram)) return false;
+
+  //the datagram is our header followed by the payload
+  if (payload != NULL &&
+      !payload->prepend(datagram,0,DATAGRAM_HEADER_LENGTH))
     return false;
-  //  if (!datagram->write16(6,0x0000)) return false;
-  return ip->sendPacket(destinationIP,UDP_PROTOCOL,
-			payloadLength +  DATAGRAM_HEADER_LENGTH );
-}//end sendDatagram
 
-uint32_t UDPHandler::calcChecksum(Buffer* buf, uint16_t len, 
-				  uint8_t* remoteIP){
+  if (payload != NULL)
+    return ip->sendPacket(destinationIP,UDP_PROTOCOL,payload);
+  return ip->sendPacket(destinationIP,UDP_PROTOCOL,len);
+}//end transmit
+
+uint32_t UDPHandler::pseudoHeaderSum(uint16_t len, uint8_t* remoteIP){
   uint32_t pseudo = len;
   pseudo += UDP_PROTOCOL;
 
@@ -147,7 +201,12 @@ uint32_t UDPHandler::calcChecksum(Buffer* buf, uint16_t len,
   pseudo += HTONS(*((uint16_t*)remoteIP));
   pseudo += HTONS(*((uint16_t*)(remoteIP+2)));
 
-  return buf->checksum(len,6,pseudo);
+  return pseudo;
+}
+
+uint32_t UDPHandler::calcChecksum(Buffer* buf, uint16_t len, 
+				  uint8_t* remoteIP){
+  return buf->checksum(len,6,pseudoHeaderSum(len,remoteIP));
 }
 
 bool UDPHandler::sendDatagram(uint8_t *destinationIP, 
@@ -160,21 +219,13 @@ bool UDPHandler::sendDatagram(uint8_t *destinationIP, uint16_t destinationPort,
 			      uint16_t sourcePort, uint16_t payloadLength, 
 			      uint8_t *payload){
 
-  //get the transmit buffer and make sure we have enough room
-  Buffer *datagram = ip->getSendPayloadBuffer();
-  if (datagram->size() <  DATAGRAM_HEADER_LENGTH  + payloadLength){
-#ifdef DEBUG
-    fprintf(stderr,"Err: buffer not large enough for datagram.\n");
-#endif
-    return false;
-  }
-
-  //populate the packet buffer
-  if (!datagram->write( DATAGRAM_HEADER_LENGTH ,payload,payloadLength)) 
-    return false;
+  //the payload goes out straight from the caller's memory
+  BufferChain chain;
+  if (!chain.append(payload,payloadLength)) return false;
 
   //send the packet
-  return sendDatagram(destinationIP,destinationPort,sourcePort,payloadLength);
+  return transmit(destinationIP,destinationPort,sourcePort,
+		  payloadLength,&chain);
 
 }//end sendDatagram
 
@@ -202,15 +253,17 @@ void UDPHandler::handlePacket(uint8_t *sourceIP, Buffer *datagram){
   if (datagram->size() <  DATAGRAM_HEADER_LENGTH )
     return;
 
+  Header<UDPHeader> udp;
+  if (!udp.load(datagram)) return;
+
   //the size of the datagram should be less than or equal to the
   //ip payload. If not, discard the datagram because something is wrong
-  uint16_t udpLength;
-  if (!datagram->readNet16(4,&udpLength) || udpLength > datagram->size())
+  uint16_t datagramLength = udp.get<UDPHeader::Length>();
+  if (datagramLength > datagram->size())
     return;
   
   //verify the checksum
-  uint16_t checksum;
-  if (!datagram->readNet16(6,&checksum)) return;
+  uint16_t checksum = udp.get<UDPHeader::Checksum>();
   //the checksum is optional, so if set to all zero's we can ignore
   if (checksum != 0){
     if (checksum != calcChecksum(datagram,datagram->size(),sourceIP))
@@ -218,13 +271,8 @@ void UDPHandler::handlePacket(uint8_t *sourceIP, Buffer *datagram){
   }
 
   //determine our port and call our port listener
-  uint16_t destinationPort;
-  uint16_t sourcePort;
-  uint16_t datagramLength;
-
-  if (!datagram->readNet16(0,&sourcePort)) return;
-  if (!datagram->readNet16(2,&destinationPort)) return;
-  if (!datagram->readNet16(4,&datagramLength)) return;
+  uint16_t sourcePort = udp.get<UDPHeader::SourcePort>();
+  uint16_t destinationPort = udp.get<UDPHeader::DestinationPort>();
   
   DatagramReceiver *receiver = getListener(destinationPort);
   
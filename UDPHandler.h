@@ -15,6 +15,7 @@ class DatagramReceiver{
 typedef struct listenerMap{
   uint16_t port;
   DatagramReceiver *receiver;
+  bool broadcasts;
 } listenerMap;
 
 
@@ -25,15 +26,29 @@ class UDPHandler: PacketHandler{
   listenerMap *receivers;
   OffsetBuffer *sendPayloadBuffer;
 
+  uint32_t pseudoHeaderSum(uint16_t len, uint8_t* remoteIP);
   uint32_t calcChecksum(Buffer* buf, uint16_t len, uint8_t* remoteIP);
+  bool transmit(uint8_t *destinationIP, uint16_t destinationPort, 
+		uint16_t sourcePort, uint16_t payloadLength, 
+		BufferChain *payload);
 
  public:
   UDPHandler(IPHandler *ipHandler, uint8_t receiverCount);
   ~UDPHandler();
 
   void handlePacket(uint8_t* sourceIP, Buffer *packet);
+
+  //true if a listener has asked for broadcast datagrams
+  bool wantsBroadcasts();
   
-  bool registerListener(uint16_t port, DatagramReceiver *receiver);
+  //broadcasts says whether the listener wants datagrams sent to our
+  //broadcast address.  It only shapes the receive filter (see
+  //EtherControl::setReceiveFilter): ARP needs broadcasts too and the
+  //controller matches a single pattern, so one such listener opens the
+  //filter to every broadcast on the LAN, not just those for its port.
+  //Without a filter, every listener is handed broadcasts as well
+  bool registerListener(uint16_t port, DatagramReceiver *receiver,
+			bool broadcasts = false);
   DatagramReceiver* getListener(uint16_t port);
   void unregisterListener(uint16_t port);
   
@@ -44,6 +59,11 @@ class UDPHandler: PacketHandler{
   
   bool sendDatagram(uint8_t *destinationIP,uint16_t destinationPort,
 		    uint16_t sourcePort, uint16_t payloadLength,uint8_t *payload);
+
+  //send the first payloadLength bytes of payload, which may be any
+  //Buffer; it is gathered as the frame is sent rather than copied here
+  bool sendDatagram(uint8_t *destinationIP,uint16_t destinationPort,
+		    uint16_t sourcePort, uint16_t payloadLength,Buffer *payload);
   
   bool sendDatagram(uint8_t *destinationIP, uint16_t destinationPort, 
 		    uint16_t sourcePort, char* message);
@@ -0,0 +1,122 @@
+/*
+ * This is an EthernetDriver implementation for a link on a VirtualSwitch.
+ * See VirtualLinkDriver.h and VirtualSwitch.h for details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "VirtualLinkDriver.h"
+
+/* ======================================================================= */
+/*                            I N I T I A L I Z E                          */
+/* ======================================================================= */
+VirtualLinkDriver::VirtualLinkDriver(uint8_t* mac, VirtualSwitch* vswitch,
+				     uint8_t queueCapacity):
+  EthernetDriver(mac){
+
+  this->sendBuffer = new MemBuffer(VLINK_MAX_FRAMELEN,sendData);
+  this->recvBuffer = new MemBuffer(VLINK_MAX_FRAMELEN,recvData);
+  this->stashBuffer = new MemBuffer(VLINK_STASH_SIZE,stashData);
+
+  this->queue = (uint8_t*)malloc((uint32_t)queueCapacity*VLINK_MAX_FRAMELEN);
+  this->queueLengths = (uint16_t*)malloc(sizeof(uint16_t)*queueCapacity);
+  if (this->queue == NULL || this->queueLengths == NULL)
+    this->queueCapacity = 0;
+  else
+    this->queueCapacity = queueCapacity;
+
+  this->queueHead = 0;
+  this->queueCount = 0;
+  this->framesDropped = 0;
+  this->poweredUp = true;
+
+  this->vswitch = NULL;
+  setSwitch(vswitch);
+}
+
+VirtualLinkDriver::~VirtualLinkDriver(){
+  setSwitch(NULL);
+  free(queue);
+  free(queueLengths);
+  delete sendBuffer;
+  delete recvBuffer;
+  delete stashBuffer;
+}
+
+void VirtualLinkDriver::setSwitch(VirtualSwitch* vswitch){
+  if (this->vswitch != NULL)
+    this->vswitch->detach(this);
+
+  this->vswitch = vswitch;
+
+  if (vswitch != NULL && !vswitch->attach(this))
+    this->vswitch = NULL; //the switch is out of ports
+}
+
+VirtualSwitch* VirtualLinkDriver::getSwitch(){
+  return this->vswitch;
+}
+
+/* ======================================================================= */
+/*                 D A T A      B U F F E R     A C C E S S                */
+/* ======================================================================= */
+Buffer* VirtualLinkDriver::getSendBuffer(){ return sendBuffer; }
+Buffer* VirtualLinkDriver::getReceiveBuffer(){ return recvBuffer; }
+Buffer* VirtualLinkDriver::getStashBuffer(){ return stashBuffer; }
+
+/* ======================================================================= */
+/*                    S E N D      A N D      R E C E I V E                */
+/* ======================================================================= */
+void VirtualLinkDriver::sendFrame(uint16_t len){
+  if (!isLinkUp()) return;
+  if (len > VLINK_MAX_FRAMELEN) return;
+
+  vswitch->forward(this,sendData,len);
+}
+
+bool VirtualLinkDriver::deliver(const uint8_t* frame, uint16_t len){
+  if (!this->poweredUp || len > VLINK_MAX_FRAMELEN ||
+      queueCount >= queueCapacity){
+    framesDropped++;
+    return false;
+  }
+
+  uint8_t slot = (queueHead + queueCount) % queueCapacity;
+  memcpy(queue + (uint32_t)slot*VLINK_MAX_FRAMELEN,frame,len);
+  queueLengths[slot] = len;
+  queueCount++;
+  return true;
+}
+
+uint16_t VirtualLinkDriver::receiveFrame(){
+  if (queueCount == 0) return 0;
+
+  uint16_t len = queueLengths[queueHead];
+  memcpy(recvData,queue + (uint32_t)queueHead*VLINK_MAX_FRAMELEN,len);
+
+  queueHead = (queueHead + 1) % queueCapacity;
+  queueCount--;
+
+  return len;
+}
+
+/* ======================================================================= */
+/*                      P O W E R     M A N A G E M E N T                  */
+/* ======================================================================= */
+bool VirtualLinkDriver::isLinkUp(){
+  return this->vswitch != NULL && this->poweredUp;
+}
+
+void VirtualLinkDriver::powerDown(){
+  this->poweredUp = false;
+}
+
+void VirtualLinkDriver::powerUp(){
+  this->poweredUp = true;
+}
+
+/* ======================================================================= */
+/*                                A C C E S S O R S                        */
+/* ======================================================================= */
+uint8_t VirtualLinkDriver::getPendingFrames(){ return queueCount; }
+uint32_t VirtualLinkDriver::getFramesDropped(){ return framesDropped; }
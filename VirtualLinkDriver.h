@@ -0,0 +1,81 @@
+/*
+ *  An EthernetDriver that is connected to a VirtualSwitch rather than
+ *  to a physical network.  Frames sent through the driver are handed to
+ *  the switch, which delivers them into the receive queue of the
+ *  destination link(s).  receiveFrame() returns queued frames one at a
+ *  time, exactly as a controller returns frames from its receive ring.
+ *
+ *  The receive queue holds a fixed number of frames.  If a link is not
+ *  serviced quickly enough the queue fills and further frames are
+ *  dropped, which mirrors a receive buffer overflow on real hardware.
+ *
+ *  See VirtualSwitch.h for an example.
+ */
+#ifndef VIRTUALLINKDRIVER_H
+#define VIRTUALLINKDRIVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <EthernetDriver.h>
+#include <MemBuffer.h>
+
+class VirtualSwitch;
+#include "VirtualSwitch.h"
+
+//largest frame we will send or receive, excluding the CRC
+#define VLINK_MAX_FRAMELEN   1514
+
+//the same amount of spare memory the ENC28J60 offers
+#define VLINK_STASH_SIZE     3584
+
+class VirtualLinkDriver: public EthernetDriver {
+
+  VirtualSwitch* vswitch;
+  bool poweredUp;
+
+  //a ring of received frames waiting for receiveFrame()
+  uint8_t* queue;
+  uint16_t* queueLengths;
+  uint8_t queueCapacity;
+  uint8_t queueHead;
+  uint8_t queueCount;
+  uint32_t framesDropped;
+
+  uint8_t sendData[VLINK_MAX_FRAMELEN];
+  uint8_t recvData[VLINK_MAX_FRAMELEN];
+  uint8_t stashData[VLINK_STASH_SIZE];
+
+  MemBuffer *sendBuffer;
+  MemBuffer *recvBuffer;
+  MemBuffer *stashBuffer;
+
+public:
+
+  VirtualLinkDriver(uint8_t* mac, VirtualSwitch* vswitch = NULL,
+		    uint8_t queueCapacity = 8);
+  ~VirtualLinkDriver();
+
+  Buffer* getSendBuffer();
+  Buffer* getReceiveBuffer();
+  Buffer* getStashBuffer();
+
+  void sendFrame (uint16_t len);
+  uint16_t receiveFrame();
+
+  bool isLinkUp ();
+  void powerDown();
+  void powerUp();
+
+  //connect the link to a switch (or disconnect it with NULL)
+  void setSwitch(VirtualSwitch* vswitch);
+  VirtualSwitch* getSwitch();
+
+  //called by the switch to queue a frame for receipt.  returns false
+  //if the frame was dropped because the link is down or the queue is full
+  bool deliver(const uint8_t* frame, uint16_t len);
+
+  uint8_t getPendingFrames();
+  uint32_t getFramesDropped();
+};
+
+#endif
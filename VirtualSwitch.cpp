@@ -0,0 +1,107 @@
+/*
+ * An in-process ethernet switch for VirtualLinkDrivers.
+ * See VirtualSwitch.h for usage.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "VirtualSwitch.h"
+
+#define MAC_SIZE 6
+
+/* ======================================================================= */
+/*                            I N I T I A L I Z E                          */
+/* ======================================================================= */
+VirtualSwitch::VirtualSwitch(uint8_t portCapacity){
+  this->ports = (VirtualLinkDriver**)
+    malloc(sizeof(VirtualLinkDriver*) * portCapacity);
+  if (this->ports == NULL)
+    this->portCapacity = 0;
+  else
+    this->portCapacity = portCapacity;
+
+  this->portCount = 0;
+  this->framesForwarded = 0;
+  this->framesDropped = 0;
+}
+
+VirtualSwitch::~VirtualSwitch(){
+  //let the links know they are no longer connected to anything
+  while (this->portCount > 0)
+    ports[0]->setSwitch(NULL);
+
+  free(this->ports);
+}
+
+/* ======================================================================= */
+/*                                 P O R T S                               */
+/* ======================================================================= */
+bool VirtualSwitch::attach(VirtualLinkDriver* link){
+
+  //already attached
+  for(uint8_t i=0; i<portCount; i++)
+    if (ports[i] == link) return true;
+
+  if (portCount >= portCapacity) return false;
+
+  ports[portCount++] = link;
+  return true;
+}
+
+void VirtualSwitch::detach(VirtualLinkDriver* link){
+  for(uint8_t i=0; i<portCount; i++){
+    if (ports[i] == link){
+      //keep the port list packed
+      ports[i] = ports[portCount-1];
+      portCount--;
+      return;
+    }
+  }
+}
+
+/* ======================================================================= */
+/*                            F O R W A R D I N G                          */
+/* ======================================================================= */
+void VirtualSwitch::forward(VirtualLinkDriver* from, const uint8_t* frame,
+			    uint16_t len){
+
+  if (len < MAC_SIZE){
+    framesDropped++;
+    return;
+  }
+
+  //the group bit of the destination MAC indicates
+  //broadcast or multicast; flood it to everyone else
+  if (frame[0] & 0x01){
+    for(uint8_t i=0; i<portCount; i++){
+      if (ports[i] == from) continue;
+      if (ports[i]->deliver(frame,len))
+	framesForwarded++;
+      else
+	framesDropped++;
+    }
+    return;
+  }
+
+  //otherwise look for the port that owns the destination address
+  for(uint8_t i=0; i<portCount; i++){
+    if (ports[i] == from) continue;
+    if (memcmp(ports[i]->getMACAddr(),frame,MAC_SIZE) == 0){
+      if (ports[i]->deliver(frame,len))
+	framesForwarded++;
+      else
+	framesDropped++;
+      return;
+    }
+  }
+
+  //nobody on the switch owns the address
+  framesDropped++;
+}
+
+/* ======================================================================= */
+/*                                A C C E S S O R S                        */
+/* ======================================================================= */
+uint8_t VirtualSwitch::getPortCount(){ return portCount; }
+uint32_t VirtualSwitch::getFramesForwarded(){ return framesForwarded; }
+uint32_t VirtualSwitch::getFramesDropped(){ return framesDropped; }
@@ -0,0 +1,55 @@
+/*
+ *  A VirtualSwitch connects any number of VirtualLinkDrivers inside a
+ *  single process.  Frames sent by one link are forwarded by destination
+ *  MAC address to the link that owns that address.  Broadcast and
+ *  multicast frames are flooded to every other link.  Unicast frames for
+ *  an address that is not attached to the switch are dropped (and
+ *  counted), just as the receive filter on a real controller would
+ *  drop them.
+ *
+ *  Together with VirtualLinkDriver this allows several complete stacks
+ *  to talk to each other without a TAP device, root privileges, or
+ *  any hardware at all:
+ *
+ *      VirtualSwitch* sw = new VirtualSwitch(4);
+ *      VirtualLinkDriver* a = new VirtualLinkDriver(macA,sw);
+ *      VirtualLinkDriver* b = new VirtualLinkDriver(macB,sw);
+ *      ... build an EtherControl/ARPHandler/IPHandler stack on each ...
+ *
+ *      loop:
+ *          controlA->processFrame();
+ *          controlB->processFrame();
+ */
+#ifndef VIRTUALSWITCH_H
+#define VIRTUALSWITCH_H
+
+#include <stdint.h>
+
+class VirtualLinkDriver;
+#include "VirtualLinkDriver.h"
+
+class VirtualSwitch {
+
+  VirtualLinkDriver** ports;
+  uint8_t portCapacity;
+  uint8_t portCount;
+
+  uint32_t framesForwarded;
+  uint32_t framesDropped;
+
+ public:
+  VirtualSwitch(uint8_t portCapacity = 8);
+  ~VirtualSwitch();
+
+  bool attach(VirtualLinkDriver* link);
+  void detach(VirtualLinkDriver* link);
+
+  //forward a frame sent by the given link to its destination(s)
+  void forward(VirtualLinkDriver* from, const uint8_t* frame, uint16_t len);
+
+  uint8_t getPortCount();
+  uint32_t getFramesForwarded();
+  uint32_t getFramesDropped();
+};
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ *  Helpers shared by the benchmark executables.
+ *
+ *  Each benchmark runs a piece of the stack in a tight loop on the host
+ *  and prints one line per case:
+ *
+ *     <name>  <iterations>  <ns per iteration>  <MB/s>
+ *
+ *  The MB/s column is only meaningful when the case moves a known number
+ *  of bytes per iteration, and is left blank otherwise.  Numbers from a
+ *  host build are no substitute for measurements on an atmega, but they
+ *  are repeatable, which makes them useful for comparing two versions of
+ *  the same code.
+ *
+ *  Benchmarks of the ENC28J60 driver count what goes over the SPI bus
+ *  instead of timing it (see ENC28J60Sim.h), and print
+ *
+ *     <name>  <iterations>  <transactions per iteration>  <bytes per iteration>
+ *
+ *  Most benchmarks take an optional iteration count as their first
+ *  argument.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <VirtualSwitch.h>
+#include <VirtualLinkDriver.h>
+#include <EtherControl.h>
+#include <ARPHandler.h>
+#include <IPHandler.h>
+#include <UDPHandler.h>
+#include <TCPHandler.h>
+
+static inline uint64_t benchNanos(){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static inline uint32_t benchIterations(int argc, char** argv,
+				       uint32_t defaultIterations){
+  if (argc > 1) return (uint32_t)strtoul(argv[1],NULL,10);
+  return defaultIterations;
+}
+
+static inline void benchHeader(){
+  printf("%-40s %10s %12s %10s\n","case","iterations","ns/iter","MB/s");
+}
+
+//bytes is the number of bytes processed per iteration (or 0)
+static inline void benchReport(const char* name, uint32_t iterations,
+			       uint64_t nanos, uint32_t bytes){
+  double perIteration = iterations ? (double)nanos / iterations : 0;
+  if (bytes > 0 && nanos > 0)
+    printf("%-40s %10u %12.1f %10.1f\n",name,iterations,perIteration,
+	   (double)bytes * iterations * 1000.0 / nanos);
+  else
+    printf("%-40s %10u %12.1f %10s\n",name,iterations,perIteration,"");
+}
+
+static inline void benchSPIHeader(){
+  printf("%-40s %10s %12s %10s\n","case","iterations","txn/iter","bytes/iter");
+}
+
+static inline void benchSPIReport(const char* name, uint32_t iterations,
+				  uint32_t transactions, uint32_t bytes){
+  double n = iterations ? iterations : 1;
+  printf("%-40s %10u %12.1f %10.1f\n",name,iterations,transactions / n,
+	 bytes / n);
+}
+
+//keeps the compiler from optimising away a result
+static volatile uint32_t benchSink;
+
+/*
+ * A complete protocol stack attached to a VirtualSwitch.  Two of these
+ * on the same switch can talk to each other without any hardware:
+ *
+ *    VirtualSwitch sw;
+ *    BenchStack a(1,&sw), b(2,&sw);   //10.0.0.1 and 10.0.0.2
+ *    a.resolve(b);
+ *
+ * A stack may also be built on a driver made elsewhere, which must use
+ * the MAC address benchMAC gives for the stack's id.
+ */
+static inline void benchMAC(uint8_t id, uint8_t mac[6]){
+  mac[0] = 0x02; mac[1] = mac[2] = mac[3] = mac[4] = 0; mac[5] = id;
+}
+
+class BenchStack {
+public:
+  uint8_t mac[6];
+  uint8_t ip[4];
+  EthernetDriver* driver;
+  EtherControl* control;
+  ARPHandler* arp;
+  IPHandler* ipHandler;
+  UDPHandler* udp;
+  TCPHandler* tcp;
+
+  BenchStack(uint8_t id, VirtualSwitch* vswitch, uint8_t queueCapacity = 8){
+    benchMAC(id,mac);
+    build(id,new VirtualLinkDriver(mac,vswitch,queueCapacity));
+  }
+
+  BenchStack(uint8_t id, EthernetDriver* driver){
+    benchMAC(id,mac);
+    build(id,driver);
+  }
+
+  void build(uint8_t id, EthernetDriver* driver){
+    static uint8_t gateway[] = {10,0,0,254};
+    static uint8_t mask[] = {255,255,255,0};
+
+    ip[0] = 10; ip[1] = ip[2] = 0; ip[3] = id;
+
+    this->driver = driver;
+    control = new EtherControl(driver);
+    arp = new ARPHandler(ip,4,control);
+    ipHandler = new IPHandler(ip,gateway,mask,arp,control);
+    udp = new UDPHandler(ipHandler,4);
+    //a single socket gets the whole stash, so segments can be full size
+    tcp = new TCPHandler(ipHandler,1,driver->getStashBuffer());
+  }
+
+  //process every frame waiting on the link
+  void drain(){
+    while(driver->getPendingFrames() > 0)
+      control->processFrame();
+  }
+
+  //make sure both stacks know each other's MAC address
+  void resolve(BenchStack& other){
+    arp->requestMACAddress(other.ip);
+    other.arp->requestMACAddress(ip);
+    for(int i=0; i<4; i++){
+      drain();
+      other.drain();
+    }
+  }
+};
+
+#endif
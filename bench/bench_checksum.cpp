@@ -0,0 +1,49 @@
+/*
+ * Internet checksum over the Buffer types the stack checksums in
+ * practice: a MemBuffer holding a frame, and the OffsetBuffer views the
+ * IP/UDP/TCP layers hand around.
+ */
+
+#include <string.h>
+#include <MemBuffer.h>
+#include <OffsetBuffer.h>
+#include "bench.h"
+
+static void run(const char* name, Buffer* buf, uint16_t len,
+		uint32_t iterations){
+  uint64_t start = benchNanos();
+  for(uint32_t i=0; i<iterations; i++)
+    benchSink += buf->checksum(len,6);
+  benchReport(name,iterations,benchNanos() - start,len);
+}
+
+int main(int argc, char** argv){
+  uint32_t iterations = benchIterations(argc,argv,20000);
+
+  static uint8_t frame[1514];
+  for(uint16_t i=0; i<sizeof(frame); i++)
+    frame[i] = (uint8_t)(i * 7 + 3);
+
+  MemBuffer mem(sizeof(frame),frame);
+
+  //the IP payload as the protocol handlers see it: ethernet header,
+  //then IP header skipped
+  OffsetBuffer ipPayload(&mem,14);
+  OffsetBuffer tcpPayload(&ipPayload,20);
+
+  static const uint16_t sizes[] = {20, 64, 512, 1480};
+  char name[64];
+
+  benchHeader();
+  for(uint8_t i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++){
+    snprintf(name,sizeof(name),"checksum MemBuffer %u",sizes[i]);
+    run(name,&mem,sizes[i],iterations);
+  }
+  for(uint8_t i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++){
+    if (sizes[i] > tcpPayload.size()) continue;
+    snprintf(name,sizeof(name),"checksum OffsetBuffer(2) %u",sizes[i]);
+    run(name,&tcpPayload,sizes[i],iterations);
+  }
+
+  return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * Buffer to buffer copies for each pair of buffer types the stack
+ * copies between.  CountingBuffer stands in for a buffer that lives on
+ * a controller (like the ENC28J60Buffer): it keeps its data in memory
+ * but offers no shortcuts, and counts the read/write calls made on it,
+ * each of which would be an SPI transaction on real hardware.
+ *
+ * The copy+sum cases compare copying data and then reading the copy back
+ * to checksum it with copyToAndSum, which checksums the data on
+ * whichever side of the copy is in memory.
+ */
+
+#include <string.h>
+#include <MemBuffer.h>
+#include <OffsetBuffer.h>
+#include "bench.h"
+
+//read/write calls made on any CountingBuffer
+static uint32_t deviceCalls;
+
+class CountingBuffer: public Buffer {
+  MemBuffer memory;
+public:
+  CountingBuffer(uint16_t len, uint8_t* data): memory(len,data) {}
+
+  uint16_t size(){ return memory.size(); }
+  bool write(uint16_t offset, const void* data, uint16_t len){
+    deviceCalls++;
+    return memory.write(offset,data,len);
+  }
+  bool read(uint16_t offset, void* data, uint16_t len){
+    deviceCalls++;
+    return memory.read(offset,data,len);
+  }
+  uint8_t getBufferType(){ return 0xF0; }
+};
+
+#define COPY 0          //copyTo
+#define COPY_THEN_SUM 1 //copyTo, then read the copy back to checksum it
+#define COPY_AND_SUM 2  //copyToAndSum
+
+static void run(const char* pair, Buffer* src, Buffer* dst, uint16_t len,
+		uint32_t iterations, uint8_t op = COPY){
+  char name[64];
+  deviceCalls = 0;
+
+  uint64_t start = benchNanos();
+  for(uint32_t i=0; i<iterations; i++){
+    uint32_t sum = 0;
+    if (op == COPY_AND_SUM){
+      if (!src->copyToAndSum(dst,0,0,len,&sum)) break;
+    }
+    else {
+      if (!src->copyTo(dst,0,0,len)) break;
+      if (op == COPY_THEN_SUM) sum = dst->partialChecksum(0,len);
+    }
+    benchSink += sum;
+  }
+  uint64_t elapsed = benchNanos() - start;
+
+  if (deviceCalls > 0)
+    snprintf(name,sizeof(name),"%s %u (%u calls)",pair,len,
+	     iterations ? deviceCalls / iterations : 0);
+  else
+    snprintf(name,sizeof(name),"%s %u",pair,len);
+  benchReport(name,iterations,elapsed,len);
+}
+
+int main(int argc, char** argv){
+  uint32_t iterations = benchIterations(argc,argv,20000);
+
+  static uint8_t a[1600], b[1600], c[1600];
+  memset(a,0x11,sizeof(a));
+
+  MemBuffer memA(sizeof(a),a), memB(sizeof(b),b);
+  CountingBuffer devA(sizeof(a),a), devC(sizeof(c),c);
+
+  //the views the stack copies between, e.g. the TCP payload into the
+  //stash: an OffsetBuffer over an OffsetBuffer over the frame
+  OffsetBuffer ipA(&memA,14), tcpA(&ipA,40);
+  OffsetBuffer stashB(&memB,0);
+  OffsetBuffer ipDev(&devA,14), tcpDev(&ipDev,40);
+
+  static const uint16_t sizes[] = {64, 512, 1460};
+
+  benchHeader();
+  for(uint8_t i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++){
+    uint16_t len = sizes[i];
+    run("copy Mem->Mem",&memA,&memB,len,iterations);
+    run("copy Off->Off",&tcpA,&stashB,len,iterations);
+    run("copy Mem->Dev",&memA,&devC,len,iterations);
+    run("copy Dev->Mem",&devA,&memB,len,iterations);
+    run("copy Off(Dev)->Off",&tcpDev,&stashB,len,iterations);
+    run("copy Dev->Dev",&devA,&devC,len,iterations);
+
+    //copying data to or from the controller and checksumming it
+    run("copy,sum Mem->Dev",&memA,&devC,len,iterations,COPY_THEN_SUM);
+    run("copy+sum Mem->Dev",&memA,&devC,len,iterations,COPY_AND_SUM);
+    run("copy,sum Dev->Mem",&devA,&memB,len,iterations,COPY_THEN_SUM);
+    run("copy+sum Dev->Mem",&devA,&memB,len,iterations,COPY_AND_SUM);
+  }
+
+  return 0;
+}
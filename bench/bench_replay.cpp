@@ -0,0 +1,165 @@
+/*
+ * Frames replayed from a pcap file through a complete stack.  The time
+ * covers EtherControl::processFrame and the ARP, IP, UDP and TCP
+ * handlers on the way in, plus anything the stack sends back, and is
+ * given per frame:
+ *
+ *    bench_replay [iterations] [capture.pcap]
+ *
+ * Each iteration replays the whole capture once, into a stack with the
+ * address 10.0.0.2 and the MAC address benchMAC gives for id 2.
+ *
+ * Without a file the capture is made first: a FrameCapture records the
+ * traffic one stack on a VirtualSwitch sees from another (ARP requests,
+ * UDP datagrams of several sizes and connection attempts to a closed TCP
+ * port), and the replay checks that every datagram in it reaches the
+ * listener again.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <BufferedSocket.h>
+#include <FrameCapture.h>
+#include <PcapReplayDriver.h>
+#include "bench.h"
+
+class CountingReceiver: public DatagramReceiver {
+public:
+  uint32_t datagrams;
+  CountingReceiver(): datagrams(0) {}
+  void handleDatagram(uint8_t* sourceIP, uint16_t sourcePort,
+		      Buffer* packet){
+    datagrams++;
+  }
+};
+
+//write what stack 2 sees of stack 1 to a pcap file.  Returns the
+//number of datagrams in it, or 0 if the file could not be written
+static uint32_t makeCapture(const char* path){
+  VirtualSwitch vswitch;
+  BenchStack a(1,&vswitch), b(2,&vswitch);
+  a.resolve(b);
+
+  CountingReceiver receiver;
+  b.udp->registerListener(7,&receiver);
+
+  FrameCapture capture(32,PCAP_REPLAY_MAX_FRAMELEN);
+  b.control->setCapture(&capture);
+
+  static uint8_t payload[1472];
+  memset(payload,0x5A,sizeof(payload));
+  static const uint16_t sizes[] = {16, 512, 1472};
+
+  for(uint8_t i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++){
+    a.arp->requestMACAddress(b.ip);
+    b.drain();
+    a.drain();
+    for(uint8_t n=0; n<4; n++){
+      a.udp->sendDatagram(b.ip,7,1000,sizes[i],payload);
+      b.drain();
+    }
+  }
+
+  //nobody listens on port 81, so the SYNs go unanswered
+  BufferedSocket client(b.ip,81,512);
+  a.tcp->registerSocket(&client);
+  client.connect();
+  b.drain();
+
+  b.control->setCapture(NULL);
+
+  FILE* out = fopen(path,"wb");
+  if (out == NULL) return 0;
+  bool written = capture.dump(out);
+  fclose(out);
+  return written ? receiver.datagrams : 0;
+}
+
+int main(int argc, char** argv){
+  uint32_t iterations = benchIterations(argc,argv,10000);
+
+  char path[] = "/tmp/bench_replayXXXXXX";
+  const char* file = argc > 2 ? argv[2] : path;
+  uint32_t expected = 0;
+
+  if (argc <= 2){
+    int fd = mkstemp(path);
+    if (fd < 0){
+      fprintf(stderr,"could not create %s\n",path);
+      return 1;
+    }
+    close(fd);
+    expected = makeCapture(path);
+    if (expected == 0){
+      fprintf(stderr,"could not write a capture to %s\n",path);
+      unlink(path);
+      return 1;
+    }
+  }
+
+  uint8_t mac[6];
+  benchMAC(2,mac);
+  PcapReplayDriver* replay = new PcapReplayDriver(mac,file);
+  if (!replay->isOpen()){
+    fprintf(stderr,"%s is not an ethernet pcap file\n",file);
+    if (argc <= 2) unlink(path);
+    return 1;
+  }
+
+  BenchStack stack(2,replay);
+  CountingReceiver receiver;
+  stack.udp->registerListener(7,&receiver);
+
+  //frames and bytes in one pass, counting what the stack gets
+  uint32_t frames = 0;
+  uint32_t bytes = 0;
+  uint16_t len;
+  while((len = replay->receiveFrame()) > 0){
+    frames++;
+    bytes += len;
+  }
+
+  uint64_t start = benchNanos();
+  for(uint32_t n=0; n<iterations; n++){
+    replay->rewind();
+    do
+      stack.control->processFrame();
+    while(!replay->isFinished());
+  }
+  uint64_t elapsed = benchNanos() - start;
+
+  //the driver says there is more for as long as there is (records it
+  //will skip aside, which a capture of our own doesn't have)
+  replay->rewind();
+  uint32_t reported = 0;
+  while(replay->getPendingFrames() > 0 && reported <= frames){
+    replay->receiveFrame();
+    reported++;
+  }
+
+  if (argc <= 2) unlink(path);
+
+  benchHeader();
+  benchReport("replay frame",frames * iterations,elapsed,
+	      frames ? bytes / frames : 0);
+  fflush(stdout);
+  if (replay->getFramesSkipped() > 0)
+    fprintf(stderr,"%u records skipped\n",replay->getFramesSkipped());
+
+  if (frames == 0){
+    fprintf(stderr,"%s holds no frames\n",file);
+    return 1;
+  }
+  if (expected > 0 && reported != frames){
+    fprintf(stderr,"%u frames reported pending, expected %u\n",
+	    reported,frames);
+    return 1;
+  }
+  if (expected > 0 && receiver.datagrams != expected * iterations){
+    fprintf(stderr,"only %u of %u datagrams arrived\n",
+	    receiver.datagrams,expected * iterations);
+    return 1;
+  }
+
+  return 0;
+}
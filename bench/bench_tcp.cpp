@@ -0,0 +1,68 @@
+/*
+ * TCP segments between two stacks on a VirtualSwitch.  The stack waits
+ * for each segment to be acknowledged before sending the next, so an
+ * iteration is one full round trip: data segment out, received and
+ * read by the server, ACK back to the client.
+ */
+
+#include <string.h>
+#include <BufferedSocket.h>
+#include "bench.h"
+
+int main(int argc, char** argv){
+  uint32_t iterations = benchIterations(argc,argv,50000);
+
+  VirtualSwitch vswitch;
+  BenchStack a(1,&vswitch), b(2,&vswitch);
+  a.resolve(b);
+
+  //the window in each ACK is taken before the server reads the data, so
+  //leave room for a full segment on top of the one being acknowledged
+  BufferedSocket server(80,8192);
+  b.tcp->registerSocket(&server);
+  BufferedSocket client(b.ip,80,2048);
+  a.tcp->registerSocket(&client);
+
+  client.connect();
+  for(int i=0; i<4 && !client.readyToSend(); i++){
+    b.drain();
+    a.drain();
+  }
+  if (!client.readyToSend()){
+    fprintf(stderr,"could not establish a connection\n");
+    return 1;
+  }
+
+  static uint8_t data[1460];
+  static uint8_t sink[1460];
+  memset(data,0x5A,sizeof(data));
+
+  uint16_t maxPayload = client.getMaxSendPayload();
+  if (maxPayload > sizeof(data)) maxPayload = sizeof(data);
+  const uint16_t sizes[] = {64, 512, maxPayload};
+  char name[64];
+
+  benchHeader();
+  for(uint8_t i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++){
+    uint32_t sent = 0;
+    uint64_t start = benchNanos();
+    for(uint32_t n=0; n<iterations; n++){
+      if (!client.send(data,sizes[i])) break;
+      b.drain();
+      while(server.dataAvailable() > 0)
+	server.read(sink,sizeof(sink));
+      a.drain();
+      if (!client.readyToSend()) break;
+      sent++;
+    }
+    uint64_t elapsed = benchNanos() - start;
+    snprintf(name,sizeof(name),"tcp segment round trip %u",sizes[i]);
+    benchReport(name,sent,elapsed,sizes[i]);
+    if (sent != iterations){
+      fprintf(stderr,"%s: stalled after %u segments\n",name,sent);
+      return 1;
+    }
+  }
+
+  return 0;
+}
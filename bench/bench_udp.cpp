@@ -0,0 +1,77 @@
+/*
+ * UDP datagrams between two stacks on a VirtualSwitch.  Each iteration
+ * sends one datagram and lets the receiving stack process it, so the
+ * time covers the full send and receive paths on both sides.
+ */
+
+#include <string.h>
+#include "bench.h"
+
+class CountingReceiver: public DatagramReceiver {
+public:
+  uint32_t datagrams;
+  uint32_t bytes;
+  CountingReceiver(): datagrams(0), bytes(0) {}
+  void handleDatagram(uint8_t* sourceIP, uint16_t sourcePort,
+		      Buffer* packet){
+    datagrams++;
+    bytes += packet->size();
+  }
+};
+
+int main(int argc, char** argv){
+  uint32_t iterations = benchIterations(argc,argv,100000);
+
+  VirtualSwitch vswitch;
+  BenchStack a(1,&vswitch), b(2,&vswitch);
+  a.resolve(b);
+
+  CountingReceiver receiver;
+  b.udp->registerListener(7,&receiver);
+
+  static uint8_t payload[1472];
+  memset(payload,0x5A,sizeof(payload));
+
+  static const uint16_t sizes[] = {16, 512, 1024, 1472};
+  char name[64];
+
+  benchHeader();
+  for(uint8_t i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++){
+
+    //copy the payload in from application memory
+    receiver.datagrams = 0;
+    uint64_t start = benchNanos();
+    for(uint32_t n=0; n<iterations; n++){
+      a.udp->sendDatagram(b.ip,7,1000,sizes[i],payload);
+      b.drain();
+    }
+    uint64_t elapsed = benchNanos() - start;
+    snprintf(name,sizeof(name),"udp send+recv copy %u",sizes[i]);
+    benchReport(name,iterations,elapsed,sizes[i]);
+    if (receiver.datagrams != iterations){
+      fprintf(stderr,"%s: only %u of %u datagrams arrived\n",
+	      name,receiver.datagrams,iterations);
+      return 1;
+    }
+
+    //write the payload straight into the send buffer
+    Buffer* out = a.udp->getSendPayloadBuffer();
+    out->write(0,payload,sizes[i]);
+    receiver.datagrams = 0;
+    start = benchNanos();
+    for(uint32_t n=0; n<iterations; n++){
+      a.udp->sendDatagram(b.ip,7,1000,sizes[i]);
+      b.drain();
+    }
+    elapsed = benchNanos() - start;
+    snprintf(name,sizeof(name),"udp send+recv in-place %u",sizes[i]);
+    benchReport(name,iterations,elapsed,sizes[i]);
+    if (receiver.datagrams != iterations){
+      fprintf(stderr,"%s: only %u of %u datagrams arrived\n",
+	      name,receiver.datagrams,iterations);
+      return 1;
+    }
+  }
+
+  return 0;
+}
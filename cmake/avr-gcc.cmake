@@ -0,0 +1,30 @@
+# Toolchain file for building the library with avr-gcc.
+#
+#   cmake -S . -B build-avr -DCMAKE_TOOLCHAIN_FILE=cmake/avr-gcc.cmake \
+#         -DARDUINO_CORE_DIR=... -DARDUINO_VARIANT_DIR=...
+#
+# AVR_MCU, F_CPU and ARDUINO_VERSION may be overridden on the command line.
+
+set(CMAKE_SYSTEM_NAME Generic)
+set(CMAKE_SYSTEM_PROCESSOR avr)
+set(AVR TRUE)
+
+set(AVR_MCU "atmega328p" CACHE STRING "Target microcontroller")
+set(F_CPU "16000000L" CACHE STRING "CPU frequency")
+set(ARDUINO_VERSION "105" CACHE STRING "Value of the ARDUINO macro")
+
+find_program(AVR_CXX avr-g++)
+find_program(AVR_CC avr-gcc)
+set(CMAKE_CXX_COMPILER ${AVR_CXX})
+set(CMAKE_C_COMPILER ${AVR_CC})
+
+# there is nothing to link against when cmake checks the compiler
+set(CMAKE_TRY_COMPILE_TARGET_TYPE STATIC_LIBRARY)
+
+set(CMAKE_CXX_FLAGS_INIT
+  "-mmcu=${AVR_MCU} -DF_CPU=${F_CPU} -Os -ffunction-sections -fdata-sections -fno-exceptions -fno-threadsafe-statics")
+set(CMAKE_C_FLAGS_INIT "-mmcu=${AVR_MCU} -DF_CPU=${F_CPU} -Os")
+
+set(CMAKE_FIND_ROOT_PATH_MODE_PROGRAM NEVER)
+set(CMAKE_FIND_ROOT_PATH_MODE_LIBRARY ONLY)
+set(CMAKE_FIND_ROOT_PATH_MODE_INCLUDE ONLY)
@@ -0,0 +1,45 @@
+/*
+ * What the checks share.  CHECK reports a failed condition with the
+ * line it is on, and a check program ends with checkResult(), which is
+ * 1 if anything failed:
+ *
+ *    CHECK(Buffer::adjustChecksum(c,old,old) == c);
+ *    ...
+ *    return checkResult();
+ *
+ * CHECK_EQUAL prints the two values as well.
+ */
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+static uint32_t checkFailures = 0;
+
+#define CHECK(condition)						\
+  do {									\
+    if (!(condition)){							\
+      fprintf(stderr,"%s:%d: failed: %s\n",__FILE__,__LINE__,#condition); \
+      checkFailures++;							\
+    }									\
+  } while (0)
+
+#define CHECK_EQUAL(actual,expected)					\
+  do {									\
+    unsigned long a_ = (unsigned long)(actual);				\
+    unsigned long e_ = (unsigned long)(expected);			\
+    if (a_ != e_){							\
+      fprintf(stderr,"%s:%d: %s is %lu (0x%lx), expected %lu (0x%lx)\n", \
+	      __FILE__,__LINE__,#actual,a_,a_,e_,e_);			\
+      checkFailures++;							\
+    }									\
+  } while (0)
+
+static inline int checkResult(){
+  if (checkFailures > 0)
+    fprintf(stderr,"%u checks failed\n",checkFailures);
+  return checkFailures > 0 ? 1 : 0;
+}
+
+#endif
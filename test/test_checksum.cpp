@@ -0,0 +1,115 @@
+/*
+ * The checksum shortcuts against the long way round: RFC 1624
+ * adjustment against summing the packet again, and the sum of a
+ * BufferChain whose pieces have odd lengths (so a piece may start on
+ * the second byte of a word) against the sum of the same bytes laid
+ * out flat.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <Buffer.h>
+#include <MemBuffer.h>
+#include <BufferChain.h>
+#include "check.h"
+
+static uint16_t fold(uint32_t sum){
+  while (sum >> 16)
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  return (uint16_t)sum;
+}
+
+//the checksum of a header as written to it, its checksum field skipped
+static uint16_t fullChecksum(const uint8_t* header, uint16_t len,
+			     uint16_t checksumOffset){
+  uint32_t sum = Buffer::sumWords(header,checksumOffset);
+  sum = Buffer::sumWords(header + checksumOffset + 2,
+			 len - checksumOffset - 2,sum);
+  return (uint16_t)~fold(sum);
+}
+
+//+0 and -0 are the same checksum; a receiver accepts either
+static bool sameChecksum(uint16_t a, uint16_t b){
+  if (a == 0xFFFF) a = 0;
+  if (b == 0xFFFF) b = 0;
+  return a == b;
+}
+
+static void checkAdjust(){
+  uint8_t header[20];
+  for(uint16_t round=0; round<2000; round++){
+    for(uint8_t i=0; i<sizeof(header); i++)
+      header[i] = rand();
+    uint16_t checksum = fullChecksum(header,sizeof(header),10);
+
+    //a 16 bit field (say a port or a window)
+    uint8_t at = 2 * (rand() % 5);
+    uint16_t oldValue = Buffer::getNet16(header + at);
+    uint16_t newValue = round == 0 ? oldValue : (uint16_t)rand();
+    Buffer::putNet16(header + at,newValue);
+    uint16_t adjusted = Buffer::adjustChecksum(checksum,oldValue,newValue);
+    CHECK(sameChecksum(adjusted,fullChecksum(header,sizeof(header),10)));
+    checksum = fullChecksum(header,sizeof(header),10);
+
+    //a 32 bit field (a sequence number or an address)
+    at = 12 + 4 * (rand() % 2);
+    uint32_t oldValue32 = Buffer::getNet32(header + at);
+    uint32_t newValue32 = ((uint32_t)rand() << 16) ^ rand();
+    if (round % 7 == 0)   //only half of it changes
+      newValue32 = (oldValue32 & 0xFFFF0000) | (newValue32 & 0xFFFF);
+    Buffer::putNet32(header + at,newValue32);
+    adjusted = Buffer::adjustChecksum32(checksum,oldValue32,newValue32);
+    CHECK(sameChecksum(adjusted,fullChecksum(header,sizeof(header),10)));
+  }
+
+  //a field changed back and forth comes out where it started
+  CHECK_EQUAL(Buffer::adjustChecksum(Buffer::adjustChecksum(0x1234,7,9),9,7),
+	      0x1234);
+}
+
+static void checkChain(){
+  //pieces of odd length from four places, so none of them are merged
+  static uint8_t first[3], second[5], third[7], fourth[6];
+  uint8_t* pieces[] = {first, second, third, fourth};
+  uint16_t lengths[] = {sizeof(first), sizeof(second), sizeof(third),
+			sizeof(fourth)};
+  uint8_t flat[sizeof(first) + sizeof(second) + sizeof(third) +
+	       sizeof(fourth)];
+
+  for(uint8_t round=0; round<20; round++){
+    uint16_t at = 0;
+    for(uint8_t p=0; p<4; p++)
+      for(uint16_t i=0; i<lengths[p]; i++)
+	flat[at++] = pieces[p][i] = rand();
+
+    //the second piece comes out of a buffer, the others from memory
+    MemBuffer buffer(sizeof(second),second);
+    BufferChain chain;
+    CHECK(chain.append(first,sizeof(first)));
+    CHECK(chain.append(&buffer,0,sizeof(second)));
+    CHECK(chain.append(third,sizeof(third)));
+    CHECK(chain.append(fourth,sizeof(fourth)));
+    CHECK_EQUAL(chain.getSegmentCount(),4);
+    CHECK_EQUAL(chain.size(),sizeof(flat));
+
+    //every range, starting on either byte of a word, and with a sum
+    //already under way
+    for(uint16_t offset=0; offset<sizeof(flat); offset++)
+      for(uint16_t len=1; offset+len<=sizeof(flat); len++){
+	uint32_t start = round * 0x1357;
+	CHECK_EQUAL(fold(chain.partialChecksum(offset,len,start)),
+		    fold(Buffer::sumWords(flat + offset,len,start)));
+      }
+
+    CHECK_EQUAL(chain.checksum(sizeof(flat),6),
+		(uint16_t)~fold(Buffer::sumWords(flat,6) +
+				Buffer::sumWords(flat + 8,sizeof(flat) - 8)));
+  }
+}
+
+int main(){
+  srand(1);
+  checkAdjust();
+  checkChain();
+  return checkResult();
+}
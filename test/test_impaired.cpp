@@ -0,0 +1,339 @@
+/*
+ * ImpairedDriver: loss, duplication, reordering, latency and jitter,
+ * bandwidth and the shared slots, in both directions.  The impaired
+ * driver wraps one VirtualLinkDriver and talks to another on a
+ * VirtualSwitch, on a SimulatedClock with a fixed random seed, so every
+ * run makes the same decisions.
+ */
+
+#include <string.h>
+#include <VirtualSwitch.h>
+#include <VirtualLinkDriver.h>
+#include <ImpairedDriver.h>
+#include <SimulatedClock.h>
+#include <Host.h>
+#include "check.h"
+
+#define SLOTS 16
+
+static uint8_t localMAC[6] = {0x02,0,0,0,0,1};
+static uint8_t peerMAC[6] = {0x02,0,0,0,0,2};
+
+static SimulatedClock simClock;
+static VirtualLinkDriver* local;
+static VirtualLinkDriver* peer;
+static ImpairedDriver* impaired;
+
+//what came out of the far end of the link: the peer for IMPAIR_TX,
+//the impaired driver for IMPAIR_RX
+#define MAX_ARRIVALS 256
+static uint16_t arrivals[MAX_ARRIVALS];
+static uint32_t arrivalTimes[MAX_ARRIVALS];
+static uint16_t arrivalCount;
+
+//send a frame carrying a sequence number into one end of the link
+static void send(uint8_t direction, uint16_t seq, uint16_t len = 60){
+  static uint8_t frame[128];
+  EthernetDriver* from = direction == IMPAIR_TX ? (EthernetDriver*)impaired
+    : peer;
+
+  memset(frame,0,len);
+  memcpy(frame,direction == IMPAIR_TX ? peerMAC : localMAC,6);
+  memcpy(frame+6,direction == IMPAIR_TX ? localMAC : peerMAC,6);
+  Buffer::putNet16(frame+12,0x88B5);   //local experimental ethertype
+  Buffer::putNet16(frame+14,seq);
+  from->getSendBuffer()->write(0,frame,len);
+  from->sendFrame(len);
+}
+
+static void arrived(Buffer* frame){
+  uint16_t seq = 0xFFFF;
+  frame->readNet16(14,&seq);
+  if (arrivalCount == MAX_ARRIVALS) return;
+  arrivals[arrivalCount] = seq;
+  arrivalTimes[arrivalCount] = simClock.getMillis();
+  arrivalCount++;
+}
+
+//take everything that has come out of either end by now.  Receiving
+//is also what releases the frames held on the way out
+static void collect(){
+  while (true){
+    if (impaired->receiveFrame() > 0)
+      arrived(impaired->getReceiveBuffer());
+    else if (local->getPendingFrames() == 0)
+      break;
+  }
+
+  while (peer->getPendingFrames() > 0){
+    peer->receiveFrame();
+    arrived(peer->getReceiveBuffer());
+  }
+}
+
+static void runFor(uint32_t millis){
+  collect();
+  for(uint32_t i=0; i<millis; i++){
+    simClock.advance(1);
+    collect();
+  }
+}
+
+static void reset(){
+  impaired->clearImpairments();
+  collect();
+  impaired->resetStats();
+  arrivalCount = 0;
+}
+
+static void configure(uint8_t direction, const impairment* cfg){
+  reset();
+  impaired->setImpairment(direction,cfg);
+}
+
+static void checkLossAndDuplicates(uint8_t direction){
+  impairment cfg;
+  memset(&cfg,0,sizeof(cfg));
+  cfg.lossPct = 25;
+  cfg.duplicatePct = 25;
+  configure(direction,&cfg);
+
+  for(uint16_t seq=0; seq<200; seq++){
+    send(direction,seq);
+    collect();
+  }
+
+  //a frame comes out as often as its fate says, and at once
+  uint8_t copies[200];
+  memset(copies,0,sizeof(copies));
+  for(uint16_t i=0; i<arrivalCount; i++){
+    CHECK(arrivals[i] < 200);
+    CHECK_EQUAL(arrivalTimes[i],arrivalTimes[0]);
+    if (arrivals[i] < 200) copies[arrivals[i]]++;
+  }
+
+  uint32_t lost = 0, duplicated = 0;
+  for(uint16_t seq=0; seq<200; seq++){
+    CHECK(copies[seq] <= 2);
+    if (copies[seq] == 0) lost++;
+    if (copies[seq] == 2) duplicated++;
+  }
+
+  impairmentStats* stats = impaired->getStats(direction);
+  CHECK_EQUAL(stats->frames,200);
+  CHECK(stats->lost > 0);
+  CHECK(stats->duplicated > 0);
+  CHECK_EQUAL(stats->lost,lost);
+  CHECK_EQUAL(stats->duplicated,duplicated);
+  CHECK_EQUAL(arrivalCount,200 - lost + duplicated);
+  CHECK_EQUAL(impaired->getHeldFrames(),0);
+}
+
+static void checkReorder(uint8_t direction){
+  impairment cfg;
+  memset(&cfg,0,sizeof(cfg));
+  cfg.latency = 50;
+  configure(direction,&cfg);
+
+  send(direction,0);
+  send(direction,1);
+  collect();
+  CHECK_EQUAL(arrivalCount,0);
+  CHECK_EQUAL(impaired->getHeldFrames(),2);
+
+  //a reordered frame skips the delay and overtakes both (frames on
+  //the way in meet the impairments when they are collected)
+  impaired->getImpairment(direction)->reorderPct = 100;
+  send(direction,2);
+  collect();
+  impaired->getImpairment(direction)->reorderPct = 0;
+  CHECK_EQUAL(arrivalCount,1);
+  CHECK_EQUAL(arrivals[0],2);
+
+  runFor(50);
+  CHECK_EQUAL(arrivalCount,3);
+  CHECK_EQUAL(arrivals[1],0);
+  CHECK_EQUAL(arrivals[2],1);
+  CHECK_EQUAL(arrivalTimes[2],arrivalTimes[0] + 50);
+
+  impairmentStats* stats = impaired->getStats(direction);
+  CHECK_EQUAL(stats->reordered,1);
+  CHECK_EQUAL(stats->delayed,2);
+
+  //with nothing held, a frame that is due goes straight through
+  //without taking a slot
+  impaired->getImpairment(direction)->latency = 0;
+  send(direction,3);
+  CHECK_EQUAL(impaired->getHeldFrames(),0);
+  collect();
+  CHECK_EQUAL(arrivalCount,4);
+  CHECK_EQUAL(arrivals[3],3);
+}
+
+static void checkLatency(uint8_t direction){
+  impairment cfg;
+  memset(&cfg,0,sizeof(cfg));
+  cfg.latency = 40;
+  cfg.jitter = 10;
+  configure(direction,&cfg);
+
+  uint32_t shortest = 0xFFFFFFFF, longest = 0;
+  for(uint16_t seq=0; seq<100; seq++){
+    uint32_t sent = simClock.getMillis();
+    arrivalCount = 0;
+    send(direction,seq);
+    collect();
+
+    //the frame comes out when getMillisToNextRelease says and not before
+    uint32_t wait = impaired->getMillisToNextRelease();
+    CHECK(wait >= 30 && wait <= 50);
+    runFor(wait - 1);
+    CHECK_EQUAL(arrivalCount,0);
+    runFor(1);
+    CHECK_EQUAL(arrivalCount,1);
+    CHECK_EQUAL(arrivals[0],seq);
+
+    uint32_t delay = arrivalTimes[0] - sent;
+    CHECK_EQUAL(delay,wait);
+    if (delay < shortest) shortest = delay;
+    if (delay > longest) longest = delay;
+  }
+
+  CHECK(shortest >= 30);
+  CHECK(longest <= 50);
+  CHECK(shortest < longest);
+  CHECK_EQUAL(impaired->getStats(direction)->delayed,100);
+}
+
+static void checkBandwidth(uint8_t direction){
+  impairment cfg;
+  memset(&cfg,0,sizeof(cfg));
+  cfg.bandwidth = 10000;   //a 101 byte frame takes 10.1ms
+  configure(direction,&cfg);
+
+  uint32_t start = simClock.getMillis();
+  for(uint16_t seq=0; seq<10; seq++)
+    send(direction,seq,101);
+  runFor(120);
+
+  //the fractions of a millisecond add up: the tenth frame is a
+  //millisecond later than the rest of the spacing suggests
+  CHECK_EQUAL(arrivalCount,10);
+  for(uint16_t i=0; i<arrivalCount; i++){
+    CHECK_EQUAL(arrivals[i],i);
+    CHECK_EQUAL(arrivalTimes[i] - start,(uint32_t)101 * (i + 1) / 10);
+  }
+}
+
+//frames due at the same time come out in the order they went in,
+//whichever slots they landed in
+static void checkTieBreak(){
+  impairment cfg;
+  memset(&cfg,0,sizeof(cfg));
+  cfg.latency = 100;
+  configure(IMPAIR_TX,&cfg);
+
+  send(IMPAIR_TX,0);                              //slot 0, due at 100
+  impaired->getImpairment(IMPAIR_TX)->latency = 50;
+  send(IMPAIR_TX,1);                              //slot 1, due at 50
+  impaired->getImpairment(IMPAIR_TX)->latency = 100;
+  send(IMPAIR_TX,2);                              //slot 2, due at 100
+  runFor(50);
+  CHECK_EQUAL(arrivalCount,1);
+  CHECK_EQUAL(arrivals[0],1);
+
+  impaired->getImpairment(IMPAIR_TX)->latency = 50;
+  send(IMPAIR_TX,3);                              //slot 1, due at 100
+  runFor(50);
+  CHECK_EQUAL(arrivalCount,4);
+  CHECK_EQUAL(arrivals[1],0);
+  CHECK_EQUAL(arrivals[2],2);
+  CHECK_EQUAL(arrivals[3],3);
+}
+
+static void checkOverflow(){
+  impairment cfg;
+  memset(&cfg,0,sizeof(cfg));
+  cfg.latency = 100;
+  configure(IMPAIR_TX,&cfg);
+  impaired->setImpairment(IMPAIR_RX,&cfg);
+
+  //the slots are shared by both directions
+  for(uint16_t seq=0; seq<10; seq++)
+    send(IMPAIR_TX,seq);
+  for(uint16_t seq=10; seq<SLOTS; seq++)
+    send(IMPAIR_RX,seq);
+  collect();
+  CHECK_EQUAL(impaired->getHeldFrames(),SLOTS);
+  CHECK_EQUAL(impaired->getPendingFrames(),SLOTS - 10);
+
+  send(IMPAIR_TX,100);
+  send(IMPAIR_RX,101);
+  send(IMPAIR_RX,102);
+  collect();
+  CHECK_EQUAL(impaired->getHeldFrames(),SLOTS);
+  CHECK_EQUAL(impaired->getStats(IMPAIR_TX)->overflows,1);
+  CHECK_EQUAL(impaired->getStats(IMPAIR_RX)->overflows,2);
+  CHECK_EQUAL(impaired->getStats(IMPAIR_TX)->delayed,10);
+  CHECK_EQUAL(impaired->getStats(IMPAIR_RX)->delayed,SLOTS - 10);
+
+  //and what was held comes out in order
+  runFor(100);
+  CHECK_EQUAL(arrivalCount,SLOTS);
+  uint16_t tx = 0, rx = 10;
+  for(uint16_t i=0; i<arrivalCount; i++){
+    if (arrivals[i] < 10)
+      CHECK_EQUAL(arrivals[i],tx++);
+    else
+      CHECK_EQUAL(arrivals[i],rx++);
+  }
+  CHECK_EQUAL(tx,10);
+  CHECK_EQUAL(rx,SLOTS);
+  CHECK_EQUAL(impaired->getHeldFrames(),0);
+}
+
+//a frame that is due and would overtake nothing needs no slot, so it
+//gets through even when the other direction holds every slot
+static void checkPassThrough(){
+  impairment cfg;
+  memset(&cfg,0,sizeof(cfg));
+  cfg.latency = 100;
+  configure(IMPAIR_RX,&cfg);
+
+  for(uint16_t seq=0; seq<SLOTS; seq++)
+    send(IMPAIR_RX,seq);
+  collect();
+  CHECK_EQUAL(impaired->getHeldFrames(),SLOTS);
+
+  send(IMPAIR_TX,100);
+  collect();
+  CHECK_EQUAL(arrivalCount,1);
+  CHECK_EQUAL(arrivals[0],100);
+  CHECK_EQUAL(impaired->getStats(IMPAIR_TX)->overflows,0);
+
+  runFor(100);
+  CHECK_EQUAL(arrivalCount,SLOTS + 1);
+}
+
+int main(){
+  Host::setClockSource(&simClock);
+  Host::setRandomSeed(1);
+
+  VirtualSwitch vswitch;
+  local = new VirtualLinkDriver(localMAC,&vswitch,32);
+  peer = new VirtualLinkDriver(peerMAC,&vswitch,32);
+  impaired = new ImpairedDriver(local,SLOTS);
+
+  for(uint8_t direction=IMPAIR_TX; direction<=IMPAIR_RX; direction++){
+    checkLossAndDuplicates(direction);
+    checkReorder(direction);
+    checkLatency(direction);
+    checkBandwidth(direction);
+  }
+  checkTieBreak();
+  checkPassThrough();
+  checkOverflow();
+
+  Host::setClockSource(NULL);
+  return checkResult();
+}
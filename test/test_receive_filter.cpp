@@ -0,0 +1,187 @@
+/*
+ * Receive filtering: the multicast hash against known values, the
+ * ENC28J60 driver's filters as the simulated controller applies them
+ * to frames coming off a VirtualSwitch, and the filter EtherControl
+ * works out from a stack's handlers.
+ */
+
+#include <string.h>
+#include <VirtualSwitch.h>
+#include <VirtualLinkDriver.h>
+#include <ENC28J60Sim.h>
+#include <ENC28J60Driver.h>
+#include <ImpairedDriver.h>
+#include <EtherControl.h>
+#include <ARPHandler.h>
+#include <IPHandler.h>
+#include <UDPHandler.h>
+#include <Headers.h>
+#include "check.h"
+
+#define ENC_PIN 9
+
+static uint8_t localMAC[6] = {0x02,0,0,0,0,1};
+static uint8_t peerMAC[6] = {0x02,0,0,0,0,2};
+static uint8_t otherMAC[6] = {0x02,0,0,0,0,3};
+static uint8_t mdns[6] = {0x01,0x00,0x5E,0x00,0x00,0xFB};
+static uint8_t allNodes[6] = {0x33,0x33,0x00,0x00,0x00,0x01};
+
+static ENC28J60Sim* chip;
+static ENC28J60Driver* driver;
+static VirtualLinkDriver* peer;
+
+static uint8_t localIP[4] = {10,0,0,1};
+static uint8_t peerIP[4] = {10,0,0,2};
+static uint8_t otherIP[4] = {10,0,0,3};
+static uint8_t subnetBroadcast[4] = {10,0,0,255};
+
+//a minimum sized frame from the peer, the rest of it zero
+static uint8_t frame[60];
+static void startFrame(const uint8_t* destination, uint16_t etherType){
+  memset(frame,0,sizeof(frame));
+  memcpy(frame,destination,6);
+  memcpy(frame+6,peerMAC,6);
+  Buffer::putNet16(frame + EthernetHeader::Protocol::offset,etherType);
+}
+
+//true if the frame from the peer is taken by the chip
+static bool taken(){
+  peer->getSendBuffer()->write(0,frame,sizeof(frame));
+
+  uint32_t before = chip->getFramesReceived();
+  peer->sendFrame(sizeof(frame));
+  while(driver->getPendingFrames() > 0)
+    driver->receiveFrame();
+  return chip->getFramesReceived() != before;
+}
+
+static bool taken(const uint8_t* destination){
+  startFrame(destination,0x88B5);   //local experimental ethertype
+  return taken();
+}
+
+static bool arpRequestTaken(const uint8_t* target){
+  startFrame(broadcastMAC,0x0806);
+  uint8_t* arp = frame + EthernetHeader::LENGTH;
+  ARPHeader::HardwareType::set(arp,1);
+  ARPHeader::ProtocolType::set(arp,IP_PROTOCOL);
+  ARPHeader::HardwareLength::set(arp,6);
+  ARPHeader::ProtocolLength::set(arp,4);
+  ARPHeader::Operation::set(arp,1);
+  ARPHeader::SenderMAC::set(arp,peerMAC);
+  ARPHeader::SenderIP::set(arp,peerIP);
+  ARPHeader::TargetIP::set(arp,target);
+  return taken();
+}
+
+static bool udpBroadcastTaken(uint16_t port){
+  startFrame(broadcastMAC,IP_PROTOCOL);
+  uint8_t* ip = frame + EthernetHeader::LENGTH;
+  IPHeader::VersionLength::set(ip,0x45);
+  IPHeader::TotalLength::set(ip,IP_HEADER_LENGTH + UDPHeader::LENGTH);
+  IPHeader::TTL::set(ip,64);
+  IPHeader::Protocol::set(ip,UDP_PROTOCOL);
+  IPHeader::Source::set(ip,peerIP);
+  IPHeader::Destination::set(ip,subnetBroadcast);
+  uint8_t* udp = ip + IP_HEADER_LENGTH;
+  UDPHeader::SourcePort::set(udp,1000);
+  UDPHeader::DestinationPort::set(udp,port);
+  UDPHeader::Length::set(udp,UDPHeader::LENGTH);
+  return taken();
+}
+
+static void checkHash(){
+  CHECK_EQUAL(EthernetDriver::hashAddress(mdns),62);
+  CHECK_EQUAL(EthernetDriver::hashAddress(allNodes),51);
+
+  uint8_t table[8];
+  memset(table,0,sizeof(table));
+  EthernetDriver::addToHashTable(table,mdns);
+  CHECK_EQUAL(table[7],0x40);
+
+  //the controller picks its bit on its own
+  receiveFilter filter;
+  memset(&filter,0,sizeof(filter));
+  filter.accept = RECEIVE_UNICAST | RECEIVE_HASH;
+  memcpy(filter.hashTable,table,sizeof(table));
+  CHECK(driver->setReceiveFilter(&filter));
+  CHECK(taken(mdns));
+  CHECK(!taken(allNodes));
+  CHECK(taken(localMAC));
+
+  //the broadcast address happens to share mDNS's bit
+  CHECK_EQUAL(EthernetDriver::hashAddress(broadcastMAC),62);
+  CHECK(taken(broadcastMAC));
+}
+
+//an ImpairedDriver leaves the filtering to the driver it wraps
+static void checkImpairedFilter(){
+  ImpairedDriver impaired(driver);
+  receiveFilter filter;
+  memset(&filter,0,sizeof(filter));
+  filter.accept = RECEIVE_UNICAST;
+  CHECK(impaired.setReceiveFilter(&filter));
+  CHECK(taken(localMAC));
+  CHECK(!taken(broadcastMAC));
+
+  filter.accept = RECEIVE_UNICAST | RECEIVE_BROADCAST;
+  CHECK(impaired.setReceiveFilter(&filter));
+  CHECK(taken(broadcastMAC));
+}
+
+class NullReceiver: public DatagramReceiver {
+public:
+  void handleDatagram(uint8_t* sourceIP, uint16_t sourcePort,
+		      Buffer* packet){}
+};
+
+static void checkStackFilter(){
+  static uint8_t gateway[4] = {10,0,0,254};
+  static uint8_t mask[4] = {255,255,255,0};
+  EtherControl control(driver);
+  ARPHandler arp(localIP,2,&control);
+  IPHandler ip(localIP,gateway,mask,&arp,&control);
+  UDPHandler udp(&ip,2);
+  NullReceiver receiver;
+
+  //nobody wants broadcasts but ARP, so only requests for us get in
+  udp.registerListener(7,&receiver);
+  CHECK(control.setReceiveFilter());
+  CHECK(taken(localMAC));
+  CHECK(arpRequestTaken(localIP));
+  CHECK(!arpRequestTaken(otherIP));
+  CHECK(!udpBroadcastTaken(7));
+  CHECK(!taken(broadcastMAC));
+
+  //one listener for broadcasts and every broadcast is taken, whatever
+  //its port or protocol
+  udp.registerListener(67,&receiver,true);
+  CHECK(control.setReceiveFilter());
+  CHECK(udpBroadcastTaken(67));
+  CHECK(udpBroadcastTaken(7));
+  CHECK(arpRequestTaken(otherIP));
+  CHECK(taken(broadcastMAC));
+
+  //and closed again once it goes
+  udp.unregisterListener(67);
+  CHECK(control.setReceiveFilter());
+  CHECK(!udpBroadcastTaken(67));
+  CHECK(arpRequestTaken(localIP));
+}
+
+int main(){
+  VirtualSwitch vswitch;
+  chip = new ENC28J60Sim(localMAC,&vswitch,ENC_PIN);
+  driver = new ENC28J60Driver(localMAC,ENC_PIN);
+  peer = new VirtualLinkDriver(peerMAC,&vswitch);
+
+  //unicasts and broadcasts until told otherwise
+  CHECK(taken(localMAC));
+  CHECK(taken(broadcastMAC));
+  CHECK(!taken(otherMAC));
+
+  checkHash();
+  checkImpairedFilter();
+  checkStackFilter();
+  return checkResult();
+}